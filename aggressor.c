@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "expect.h"
+#include "memory.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "access.h"
+#include "rnd_lcg.h"
+#include "bench_common.h"
+
+/* Time between rate controller updates in seconds */
+#define CONTROL_PERIOD 0.01
+/* Fraction of the rate error corrected by each controller update */
+#define CONTROL_GAIN 0.5
+
+typedef enum {
+    PATTERN_STREAM = 0,
+    PATTERN_RANDOM,
+    PATTERN_STREAMS,
+} pattern_t;
+
+static const char *pattern_names[] = {
+    "stream", "random", "streams", NULL
+};
+
+typedef struct {
+    int cpu;
+    pthread_t thread;
+
+    char *data;
+    size_t size;
+    size_t pos;
+    uint64_t lcg_state;
+
+    /** Target rate in bytes per second, 0 if unthrottled */
+    double target;
+    /** Cycles to wait after each chunk */
+    uint64_t wait;
+    /** Set if the target rate could not be reached */
+    int saturated;
+
+    uint64_t bytes;
+    uint64_t busy_cycles;
+    uint64_t wait_cycles;
+} worker_t;
+
+static pattern_t pattern = PATTERN_STREAM;
+static size_t footprint = 0;
+static double bandwidth = 0.0;
+static unsigned int duty = 100;
+static size_t chunk_size = 64 * 1024;
+static uint16_t streams = 3;
+static size_t stream_distance = SIZE_MAX;
+static double duration = 0.0;
+
+static worker_t *workers;
+static unsigned int nworkers;
+static pthread_barrier_t barrier;
+
+#define ACCESS access_rd8
+
+static inline void
+chunk_stream(worker_t *w)
+{
+    const size_t line_size = bench_settings.line_size;
+
+    for (size_t i = 0; i < chunk_size; i += line_size) {
+        ACCESS(w->data + w->pos);
+        w->pos += line_size;
+        if (w->pos >= w->size)
+            w->pos = 0;
+    }
+}
+
+static inline void
+chunk_random(worker_t *w)
+{
+    const size_t line_size = bench_settings.line_size;
+
+    for (size_t i = 0; i < chunk_size; i += line_size) {
+        w->lcg_state = rnd_lcg64(w->lcg_state);
+        ACCESS(w->data + (w->lcg_state % w->size));
+    }
+}
+
+static inline void
+chunk_streams(worker_t *w)
+{
+    const size_t line_size = bench_settings.line_size;
+    size_t offset[streams];
+
+    for (uint16_t j = 0; j < streams; j++)
+        offset[j] = (w->pos + stream_distance * j) % w->size;
+
+    for (size_t i = 0; i < chunk_size; i += line_size * streams) {
+        for (uint16_t j = 0; j < streams; j++) {
+            ACCESS(w->data + offset[j]);
+            offset[j] += line_size;
+            if (offset[j] >= w->size)
+                offset[j] = 0;
+        }
+    }
+
+    w->pos = offset[0];
+}
+
+/**
+ * Update the wait time of a worker
+ *
+ * @param rate Achieved rate in bytes per second since the last update
+ * @param busy Average number of cycles spent accessing memory per
+ *             chunk since the last update
+ */
+static void
+control(worker_t *w, double rate, double busy)
+{
+    if (w->target > 0.0) {
+        const double period = (busy + w->wait) *
+            (1.0 + CONTROL_GAIN * (rate / w->target - 1.0));
+
+        w->wait = period > busy ? period - busy : 0;
+        w->saturated = w->wait == 0 && rate < w->target;
+    } else if (duty < 100) {
+        w->wait = busy * (100 - duty) / duty;
+    }
+}
+
+static void *
+worker_main(void *arg)
+{
+    worker_t *w = arg;
+    uint64_t ctl_bytes = 0;
+    uint64_t ctl_busy = 0;
+    uint64_t ctl_chunks = 0;
+    timing_t t;
+
+    EXPECT_ERRNO(bench_pin_thread(w->cpu) != -1);
+
+    /* Allocate and touch the data set after pinning to get memory
+     * that is local to the CPU. */
+    w->data = mem_huge_alloc(w->size);
+    EXPECT_ERRNO(w->data != NULL);
+    mem_touch(w->data, w->size, 1);
+
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+
+    timing_init(&t);
+    timing_start(&t);
+    while (!bench_stop) {
+        const uint64_t start = cycles_get();
+        uint64_t busy;
+
+        switch (pattern) {
+        case PATTERN_STREAM:
+            chunk_stream(w);
+            break;
+        case PATTERN_RANDOM:
+            chunk_random(w);
+            break;
+        case PATTERN_STREAMS:
+            chunk_streams(w);
+            break;
+        }
+
+        busy = cycles_get() - start;
+        if (w->wait)
+            cycles_wait(w->wait);
+
+        w->busy_cycles += busy;
+        w->wait_cycles += cycles_get() - start - busy;
+        w->bytes += chunk_size;
+        __atomic_fetch_add(&bench_progress, 1, __ATOMIC_RELAXED);
+
+        ctl_bytes += chunk_size;
+        ctl_busy += busy;
+        ctl_chunks++;
+
+        timing_stop(&t);
+        if (t.acc >= CONTROL_PERIOD) {
+            control(w, ctl_bytes / t.acc, (double)ctl_busy / ctl_chunks);
+            ctl_bytes = 0;
+            ctl_busy = 0;
+            ctl_chunks = 0;
+            timing_init(&t);
+        }
+        timing_start(&t);
+    }
+
+    mem_huge_free(w->data, w->size);
+
+    return NULL;
+}
+
+static void
+init()
+{
+    size_t size;
+
+    if (!footprint)
+        footprint = 2 * bench_settings.cache_shared;
+    if (stream_distance == SIZE_MAX)
+        stream_distance = bench_settings.cache_private * 1.5;
+
+    nworkers = bench_settings.ncpus;
+    workers = calloc(nworkers, sizeof(*workers));
+    EXPECT_ERRNO(workers != NULL);
+
+    /* Split the footprint evenly between the workers, but make sure
+     * that every worker gets at least one chunk. */
+    size = footprint / nworkers;
+    size -= size % bench_settings.line_size;
+    if (size < chunk_size)
+        size = chunk_size;
+
+    for (unsigned int i = 0; i < nworkers; i++) {
+        worker_t *w = &workers[i];
+
+        w->cpu = bench_settings.cpus[i];
+        w->size = size;
+        w->lcg_state = 42ULL + i;
+        w->target = bandwidth * 1E9 / nworkers;
+    }
+}
+
+static void
+run()
+{
+    double total = 0.0;
+    int saturated = 0;
+    timing_t t;
+
+    EXPECT(pthread_barrier_init(&barrier, NULL, nworkers + 1) == 0);
+    for (unsigned int i = 0; i < nworkers; i++)
+        EXPECT(pthread_create(&workers[i].thread, NULL,
+                              worker_main, &workers[i]) == 0);
+
+    /* Wait for the workers to initialize their data sets before
+     * starting the reporter and releasing them. */
+    pthread_barrier_wait(&barrier);
+    bench_interval_start();
+    pthread_barrier_wait(&barrier);
+
+    timing_init(&t);
+    timing_start(&t);
+    while (!bench_stop) {
+        const struct timespec poll = { 0, 10000000L };
+
+        nanosleep(&poll, NULL);
+        timing_stop(&t);
+        if (duration > 0.0 && t.acc >= duration)
+            bench_stop = 1;
+        timing_start(&t);
+    }
+
+    for (unsigned int i = 0; i < nworkers; i++)
+        EXPECT(pthread_join(workers[i].thread, NULL) == 0);
+    timing_stop(&t);
+    bench_interval_stop();
+
+    printf("Wall clock time: %.4f\n", t.acc);
+    for (unsigned int i = 0; i < nworkers; i++) {
+        const worker_t *w = &workers[i];
+        const uint64_t cycles = w->busy_cycles + w->wait_cycles;
+
+        printf("CPU %i: %.3f GB/s, duty cycle %.1f%%%s\n",
+               w->cpu, w->bytes / t.acc * 1E-9,
+               cycles ? 100.0 * w->busy_cycles / cycles : 0.0,
+               w->saturated ? " (saturated)" : "");
+
+        total += w->bytes / t.acc;
+        saturated |= w->saturated;
+    }
+    printf("Total bandwidth: %.3f GB/s\n", total * 1E-9);
+
+    if (saturated)
+        fprintf(stderr, "Warning: Target bandwidth could not be reached "
+                "on all CPUs.\n");
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'p':
+        for (pattern = 0; pattern_names[pattern]; pattern++) {
+            if (!strcmp(pattern_names[pattern], arg))
+                break;
+        }
+        if (!pattern_names[pattern])
+            argp_error(state, "Invalid pattern: '%s'.\n", arg);
+        break;
+
+    case 'f':
+        footprint = argp_parse_size(state, "footprint", arg);
+        break;
+
+    case 'b':
+        bandwidth = argp_parse_double(state, "bandwidth", arg);
+        if (bandwidth < 0)
+            argp_error(state, "Invalid bandwidth: Must not be negative.\n");
+        break;
+
+    case 'D':
+        duty = argp_parse_uint(state, "duty cycle", arg);
+        if (duty < 1 || duty > 100)
+            argp_error(state, "Invalid duty cycle: Must be 1-100.\n");
+        break;
+
+    case 'k':
+        chunk_size = argp_parse_size(state, "chunk size", arg);
+        break;
+
+    case 's':
+        streams = argp_parse_uint16(state, "streams", arg);
+        if (!streams)
+            argp_error(state, "Invalid streams: Must be at least 1.\n");
+        break;
+
+    case 'd':
+        stream_distance = argp_parse_size(state, "distance", arg);
+        break;
+
+    case 't':
+        duration = argp_parse_double(state, "duration", arg);
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        if (bandwidth > 0.0 && duty < 100)
+            argp_error(state, "A target bandwidth and a duty cycle can't "
+                       "be used at the same time.\n");
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "aggressor";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "pattern", 'p', "NAME", 0,
+      "Access pattern: stream, random or streams (default: stream)", 0 },
+    { "footprint", 'f', "SIZE", 0,
+      "Total data set size of all threads", 0 },
+    { "bandwidth", 'b', "GBPS", 0,
+      "Target bandwidth of all threads in GB/s, 0 for unthrottled", 0 },
+    { "duty", 'D', "PCT", 0,
+      "Fixed duty cycle in percent when no bandwidth is set", 0 },
+    { "chunk", 'k', "SIZE", 0,
+      "Bytes accessed between rate adjustments (default: 64 KiB)", 0 },
+    { "streams", 's', "NUM", 0, "Use NUM streams in the streams pattern", 0 },
+    { "distance", 'd', "NUM", 0, "Stream distance in bytes", 0 },
+    { "duration", 't', "SEC", 0,
+      "Run for SEC seconds, 0 to run until interrupted", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Generate a controlled amount of cache and memory interference"
+    "\v"
+    "This microbenchmark runs one thread per CPU in the CPU list. Each "
+    "thread repeatedly accesses a chunk of its part of the footprint using "
+    "the stream (block), random or streams (nhm_fetch_access) pattern and "
+    "then busy-waits. The wait time is adjusted continuously to make the "
+    "achieved bandwidth match the target bandwidth. The footprint defaults "
+    "to 2x the shared cache. Progress is reported every interval and a "
+    "summary is printed when the run ends.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    bench_param("Pattern", "%s", pattern_names[pattern]);
+    bench_param("Footprint", "%zu", footprint);
+    bench_param("Target bandwidth", "%.3f GB/s", bandwidth);
+    bench_param("Duty cycle", "%u%%", duty);
+    bench_param("Chunk size", "%zu", chunk_size);
+    bench_param_placement();
+    if (pattern == PATTERN_STREAMS) {
+        bench_param("Streams", "%" PRIu16, streams);
+        bench_param("Stream distance", "%zu", stream_distance);
+    }
+    printf("Threads: %u\n", nworkers);
+
+    bench_set_work(chunk_size / bench_settings.line_size, chunk_size);
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include "cyclecounter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "expect.h"
+
+#ifndef CYCLES_DEFAULT
+#define CYCLES_DEFAULT "native"
+#endif
+
+cycles_backend_t cycles_backend = CYCLES_NATIVE;
+
+static const char *backend_names[] = {
+    "native", "clock", "perf", NULL
+};
+
+/* The perf counter only counts the thread that opened it, so every
+ * thread opens its own counter on first use. */
+static __thread int perf_fd = -1;
+static __thread struct perf_event_mmap_page *perf_page = NULL;
+
+static int
+perf_open()
+{
+    struct perf_event_attr attr;
+    void *page;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd == -1)
+        return -1;
+
+    /* The first page of the mapping tells us if the counter can be
+     * read from user space using rdpmc. */
+    page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+
+    perf_fd = fd;
+    perf_page = page == MAP_FAILED ? NULL : page;
+    return 0;
+}
+
+static uint64_t
+perf_read_syscall()
+{
+    uint64_t count;
+
+    EXPECT_ERRNO(read(perf_fd, &count, sizeof(count)) == sizeof(count));
+    return count;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+static uint64_t
+perf_read_rdpmc()
+{
+    volatile struct perf_event_mmap_page *pc = perf_page;
+    uint64_t count;
+    uint32_t seq, idx;
+
+    do {
+        seq = pc->lock;
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+        idx = pc->index;
+        count = pc->offset;
+        if (!pc->cap_user_rdpmc || !idx)
+            return perf_read_syscall();
+
+        {
+            const unsigned int shift = 64 - pc->pmc_width;
+            uint32_t lo, hi;
+            int64_t pmc;
+
+            asm volatile ("rdpmc" : "=a"(lo), "=d"(hi) : "c"(idx - 1));
+            pmc = (int64_t)(((uint64_t)hi << 32 | lo) << shift) >> shift;
+            count += pmc;
+        }
+
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    } while (pc->lock != seq);
+
+    return count;
+}
+#endif
+
+static uint64_t
+perf_read()
+{
+    if (perf_fd == -1)
+        EXPECT_ERRNO(perf_open() == 0);
+
+#if defined(__i386__) || defined(__x86_64__)
+    if (perf_page)
+        return perf_read_rdpmc();
+#endif
+    return perf_read_syscall();
+}
+
+static uint64_t
+clock_read()
+{
+    struct timespec ts;
+
+    EXPECT_ERRNO(clock_gettime(CLOCK_MONOTONIC_RAW, &ts) == 0);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t
+cycles_generic_read(int mfenced)
+{
+    if (mfenced)
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    switch (cycles_backend) {
+#ifdef CYCLES_HAVE_NATIVE
+    case CYCLES_NATIVE:
+        return cycles_native_read();
+#endif
+    case CYCLES_PERF:
+        return perf_read();
+    case CYCLES_CLOCK:
+    default:
+        return clock_read();
+    }
+}
+
+int
+cycles_select(const char *name)
+{
+    int i;
+
+    for (i = 0; backend_names[i]; i++) {
+        if (!strcmp(backend_names[i], name))
+            break;
+    }
+
+    switch (i) {
+    case CYCLES_NATIVE:
+#ifndef CYCLES_HAVE_NATIVE
+        errno = ENOTSUP;
+        return -1;
+#endif
+        break;
+
+    case CYCLES_CLOCK:
+        break;
+
+    case CYCLES_PERF:
+        /* Make sure that the counter can be opened, the calling
+         * thread will use this counter. */
+        if (perf_fd == -1 && perf_open() == -1)
+            return -1;
+        break;
+
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    cycles_backend = i;
+    return 0;
+}
+
+const char *
+cycles_backend_name()
+{
+    return backend_names[cycles_backend];
+}
+
+static void __attribute__((constructor))
+cycles_init()
+{
+#ifndef CYCLES_HAVE_NATIVE
+    /* There is no architecture counter on this system, the clock is
+     * the closest match. */
+    if (!strcmp(CYCLES_DEFAULT, "native")) {
+        cycles_backend = CYCLES_CLOCK;
+        return;
+    }
+#endif
+    if (cycles_select(CYCLES_DEFAULT) == 0)
+        return;
+
+    fprintf(stderr, "Cycle counter backend '%s' unavailable (%s), "
+            "using '%s'.\n",
+            CYCLES_DEFAULT, strerror(errno),
+#ifdef CYCLES_HAVE_NATIVE
+            "native"
+#else
+            "clock"
+#endif
+        );
+#ifdef CYCLES_HAVE_NATIVE
+    cycles_backend = CYCLES_NATIVE;
+#else
+    cycles_backend = CYCLES_CLOCK;
+#endif
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
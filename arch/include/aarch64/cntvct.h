@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _CNTVCT_H
+#define _CNTVCT_H
+
+#include <stdint.h>
+
+/**
+ * Read the virtual counter of the generic timer
+ *
+ * This function is a wrapper around a read of the aarch64
+ * CNTVCT_EL0 register. The counter runs at a constant frequency
+ * (CNTFRQ_EL0) that is typically much lower than the core clock, so
+ * it counts time rather than core cycles. The isb instruction
+ * prevents the read from being executed ahead of preceding
+ * instructions.
+ */
+static inline uint64_t aarch64_cntvct_read();
+
+/**
+ * Serialize memory operations and read the virtual counter
+ *
+ * This function waits for preceding memory accesses to complete
+ * (dsb) before reading CNTVCT_EL0.
+ */
+static inline uint64_t aarch64_cntvct_read_mfenced();
+
+/**
+ * Frequency of the virtual counter in Hz
+ */
+static inline uint64_t aarch64_cntfrq_read();
+
+static inline uint64_t
+aarch64_cntvct_read()
+{
+    uint64_t cnt;
+    asm volatile ("isb\n\t"
+                  "mrs %0, cntvct_el0"
+                  : "=r"(cnt)
+                  :
+                  : "memory");
+    return cnt;
+}
+
+static inline uint64_t
+aarch64_cntvct_read_mfenced()
+{
+    uint64_t cnt;
+    asm volatile ("dsb sy\n\t"
+                  "isb\n\t"
+                  "mrs %0, cntvct_el0"
+                  : "=r"(cnt)
+                  :
+                  : "memory");
+    return cnt;
+}
+
+static inline uint64_t
+aarch64_cntfrq_read()
+{
+    uint64_t frq;
+    asm volatile ("mrs %0, cntfrq_el0"
+                  : "=r"(frq));
+    return frq;
+}
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _CPU_H
+#define _CPU_H
+
+/**
+ * Hint to the CPU that the caller is busy-waiting
+ *
+ * This function should be called in the body of spin loops. On x86
+ * it executes the pause instruction, which reduces the cost of
+ * leaving the loop and the impact on an SMT sibling. It also acts as
+ * a compiler barrier.
+ */
+static inline void
+cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    asm volatile ("pause" ::: "memory");
+#else
+    asm volatile ("" ::: "memory");
+#endif
+}
+
+#if defined(__i386__) || defined(__x86_64__) || defined(__aarch64__)
+/** Defined if cpu_flush_line can evict lines from the cache */
+#define CPU_HAVE_FLUSH 1
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+/**
+ * Check if the CPU supports the clflushopt instruction
+ *
+ * @return Non-zero if clflushopt is available.
+ */
+static inline int
+cpu_have_flushopt()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (ebx >> 23) & 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Write back and invalidate the cache line containing an address
+ *
+ * Flushes are strongly ordered with respect to each other on x86,
+ * which makes flushing large buffers slow. Use cpu_flush_line_opt
+ * for bulk flushes on CPUs that support it.
+ *
+ * @param p Address within the line to flush
+ */
+static inline void
+cpu_flush_line(const void *p)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    asm volatile ("clflush %0" :: "m"(*(const char *)p) : "memory");
+#elif defined(__aarch64__)
+    asm volatile ("dc civac, %0" :: "r"(p) : "memory");
+#else
+    (void)p;
+#endif
+}
+
+/**
+ * Weakly ordered version of cpu_flush_line
+ *
+ * Uses clflushopt on x86, which must be supported by the CPU (see
+ * cpu_have_flushopt). A cpu_fence is needed to order the flushes
+ * with later memory accesses.
+ *
+ * @param p Address within the line to flush
+ */
+static inline void
+cpu_flush_line_opt(const void *p)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    /* clflushopt is clflush with an operand size prefix. Encode it
+     * by hand to support assemblers that don't know about it. */
+    asm volatile (".byte 0x66; clflush %0"
+                  :: "m"(*(const char *)p) : "memory");
+#else
+    cpu_flush_line(p);
+#endif
+}
+
+/**
+ * Full memory barrier that also orders cache line flushes
+ */
+static inline void
+cpu_fence()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    asm volatile ("mfence" ::: "memory");
+#elif defined(__aarch64__)
+    asm volatile ("dsb ish" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+}
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
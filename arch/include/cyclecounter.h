@@ -35,8 +35,57 @@
 
 #if defined(__i386__) || defined(__x86_64__)
 #include "x86/tsc.h"
+#define CYCLES_HAVE_NATIVE
+#define cycles_native_read x86_tsc_read
+#define cycles_native_read_mfenced x86_tsc_read_mfenced
+#elif defined(__aarch64__)
+#include "aarch64/cntvct.h"
+#define CYCLES_HAVE_NATIVE
+#define cycles_native_read aarch64_cntvct_read
+#define cycles_native_read_mfenced aarch64_cntvct_read_mfenced
 #endif
 
+/**
+ * Cycle counter backends
+ *
+ * The native backend is read inline, the other backends are read
+ * through cycles_generic_read. The default backend is selected at
+ * build time (CYCLES in the Makefile) and can be changed at run time
+ * using cycles_select.
+ */
+typedef enum {
+    /** Architecture counter: TSC on x86, CNTVCT_EL0 on aarch64 */
+    CYCLES_NATIVE = 0,
+    /** clock_gettime(CLOCK_MONOTONIC_RAW), counts nanoseconds */
+    CYCLES_CLOCK,
+    /** perf_event hardware cycle counter of the calling thread */
+    CYCLES_PERF,
+} cycles_backend_t;
+
+/** Currently selected backend */
+extern cycles_backend_t cycles_backend;
+
+/**
+ * Select the cycle counter backend
+ *
+ * @param name Backend name: native, clock or perf
+ * @return 0 on success, -1 if the backend is unknown or not
+ *         supported on this system. Sets errno on error.
+ */
+int cycles_select(const char *name);
+
+/**
+ * Name of the currently selected backend
+ */
+const char *cycles_backend_name();
+
+/**
+ * Read a counter from a backend that is not read inline
+ *
+ * @param mfenced Serialize memory operations before reading
+ */
+uint64_t cycles_generic_read(int mfenced);
+
 
 /**
  * Read the local cycle counter
@@ -51,7 +100,15 @@
  * This function does not guarantee that the instruction stream is
  * serialized across, which may lead to unexpected results.
  */
-static inline uint64_t cycles_get();
+static inline uint64_t
+cycles_get()
+{
+#ifdef CYCLES_HAVE_NATIVE
+    if (__builtin_expect(cycles_backend == CYCLES_NATIVE, 1))
+        return cycles_native_read();
+#endif
+    return cycles_generic_read(0);
+}
 
 /**
  * Serialize memory operations read the local cycle counter
@@ -67,7 +124,15 @@ static inline uint64_t cycles_get();
  * Note that this function may not serialize the entire instruction
  * stream, only memory accesses are serialized.
  */
-static inline uint64_t cycles_get_mfenced();
+static inline uint64_t
+cycles_get_mfenced()
+{
+#ifdef CYCLES_HAVE_NATIVE
+    if (__builtin_expect(cycles_backend == CYCLES_NATIVE, 1))
+        return cycles_native_read_mfenced();
+#endif
+    return cycles_generic_read(1);
+}
 
 
 /**
@@ -82,37 +147,17 @@ static inline void
 cycles_wait(uint64_t cycles)
 {
 #if defined(__x86_64__)
-    x86_tsc_wait(cycles);
-#else
+    if (cycles_backend == CYCLES_NATIVE) {
+        x86_tsc_wait(cycles);
+        return;
+    }
+#endif
     const uint64_t start = cycles_get();
     const uint64_t stop = start + cycles;
     while (cycles_get() < stop)
         ;
-#endif
-}
-
-#if defined(__i386__) || defined(__x86_64__)
-
-static inline uint64_t
-cycles_get()
-{
-    return x86_tsc_read();
 }
 
-
-static inline uint64_t
-cycles_get_mfenced()
-{
-    return x86_tsc_read_mfenced();
-}
-
-
-#else
-
-#error Unsupported architecture
-
-#endif
-
 #endif
 
 /*
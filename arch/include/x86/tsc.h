@@ -61,6 +61,27 @@ static inline uint64_t x86_tsc_read();
  */
 static inline uint64_t x86_tsc_read_mfenced();
 
+/**
+ * Wait for preceding instructions to complete and read the TSC
+ *
+ * The lfence instruction does not execute until all prior
+ * instructions have completed locally (on Intel and on AMD CPUs with
+ * a serializing lfence), which prevents rdtsc from being executed
+ * early. Later instructions may still start before the TSC is read.
+ */
+static inline uint64_t x86_tsc_read_lfenced();
+
+/**
+ * Read the TSC using rdtscp
+ *
+ * rdtscp waits for all prior instructions to execute before reading
+ * the TSC and also returns the contents of IA32_TSC_AUX, which Linux
+ * initializes with the CPU and node number.
+ *
+ * @param aux Set to the value of IA32_TSC_AUX if not NULL
+ */
+static inline uint64_t x86_tscp_read(uint32_t *aux);
+
 #if defined(__x86_64__)
 
 static inline uint64_t
@@ -90,6 +111,36 @@ x86_tsc_read_mfenced()
     return tsc;
 }
 
+static inline uint64_t
+x86_tsc_read_lfenced()
+{
+    uint64_t tsc;
+    asm volatile ("lfence\n\t"
+                  "rdtsc\n\t"
+                  "shl $32, %%rdx\n\t"
+                  "or %%rdx, %%rax"
+                  : "=a"(tsc)
+                  :
+                  : "rdx");
+    return tsc;
+}
+
+static inline uint64_t
+x86_tscp_read(uint32_t *aux)
+{
+    uint64_t tsc;
+    uint32_t c;
+    asm volatile ("rdtscp\n\t"
+                  "shl $32, %%rdx\n\t"
+                  "or %%rdx, %%rax"
+                  : "=a"(tsc), "=c"(c)
+                  :
+                  : "rdx");
+    if (aux)
+        *aux = c;
+    return tsc;
+}
+
 static inline void
 x86_tsc_wait(uint64_t cycles)
 {
@@ -127,6 +178,27 @@ x86_tsc_read_mfenced()
     return ((uint64_t)edx << 32) | eax;
 }
 
+static inline uint64_t
+x86_tsc_read_lfenced()
+{
+    uint32_t eax, edx;
+    asm volatile ("lfence\n\t"
+                  "rdtsc"
+                  : "=a"(eax), "=d"(edx));
+    return ((uint64_t)edx << 32) | eax;
+}
+
+static inline uint64_t
+x86_tscp_read(uint32_t *aux)
+{
+    uint32_t eax, edx, ecx;
+    asm volatile ("rdtscp"
+                  : "=a"(eax), "=d"(edx), "=c"(ecx));
+    if (aux)
+        *aux = ecx;
+    return ((uint64_t)edx << 32) | eax;
+}
+
 #else
 
 #error Unsupported architecture
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+
+#include "expect.h"
+#include "memory.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "rnd_lcg.h"
+#include "cyclecounter.h"
+#include "bench_common.h"
+
+static size_t min_stride = 1024;
+static size_t max_stride = 1024 * 1024;
+static unsigned int max_lines = 32;
+static uint64_t accesses = 1000000;
+static unsigned int repeat = 5;
+static double jump = 30.0;
+
+static char *data;
+static size_t data_size;
+
+static unsigned int nstrides;
+/* Latency in cycles per access, max_lines x nstrides */
+static double *latency;
+
+static void * volatile chase_sink;
+
+/**
+ * Link lines separated by stride into a random cycle
+ */
+static void
+init_chase(unsigned int lines, size_t stride)
+{
+    unsigned int order[lines];
+    uint64_t lcg_state = 42ULL;
+
+    for (unsigned int i = 0; i < lines; i++)
+        order[i] = i;
+    for (unsigned int i = lines - 1; i > 0; i--) {
+        unsigned int j, tmp;
+
+        lcg_state = rnd_lcg64(lcg_state);
+        j = (lcg_state >> 16) % i;
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (unsigned int i = 0; i < lines; i++)
+        *(void **)(data + order[i] * stride) =
+            data + order[(i + 1) % lines] * stride;
+}
+
+/**
+ * Measure the latency of a pointer chase through lines separated by
+ * stride
+ *
+ * @return Minimum number of cycles per access over all repetitions
+ */
+static double
+measure(unsigned int lines, size_t stride)
+{
+    double best = 0.0;
+
+    init_chase(lines, stride);
+
+    for (unsigned int r = 0; r <= repeat; r++) {
+        void **p = (void **)data;
+        uint64_t start, cycles;
+
+        start = cycles_get();
+        for (uint64_t i = 0; i < accesses; i++)
+            p = (void **)*p;
+        cycles = cycles_get() - start;
+        chase_sink = p;
+
+        /* The first pass warms the caches and is not measured */
+        if (r && (r == 1 || (double)cycles / accesses < best))
+            best = (double)cycles / accesses;
+    }
+
+    return best;
+}
+
+static void
+run()
+{
+    printf("%5s", "Lines");
+    for (size_t stride = min_stride; stride <= max_stride; stride *= 2)
+        printf(" %8zu", stride);
+    printf("\n");
+
+    for (unsigned int k = 1; k <= max_lines; k++) {
+        unsigned int s = 0;
+
+        printf("%5u", k);
+        for (size_t stride = min_stride; stride <= max_stride;
+             stride *= 2, s++) {
+            const double l = measure(k, stride);
+
+            latency[(k - 1) * nstrides + s] = l;
+            printf(" %8.1f", l);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * Report the number of lines where the latency jumps for every stride
+ *
+ * A jump from k - 1 to k lines with the same stride means that k
+ * lines don't fit in a set of some cache level, i.e., the cache has
+ * k - 1 ways if the stride is a multiple of its size divided by the
+ * number of ways.
+ */
+static void
+report()
+{
+    unsigned int s = 0;
+
+    printf("\nConflicts (lines: cycles before -> after):\n");
+    for (size_t stride = min_stride; stride <= max_stride; stride *= 2, s++) {
+        int found = 0;
+
+        printf("%8zu:", stride);
+        for (unsigned int k = 2; k <= max_lines; k++) {
+            const double prev = latency[(k - 2) * nstrides + s];
+            const double cur = latency[(k - 1) * nstrides + s];
+
+            if (cur > prev * (1.0 + jump / 100.0)) {
+                printf(" %u: %.1f -> %.1f (%u ways)", k, prev, cur, k - 1);
+                found = 1;
+            }
+        }
+        if (!found)
+            printf(" none");
+        printf("\n");
+    }
+}
+
+static void
+init()
+{
+    EXPECT_ERRNO(bench_pin_cpu() != -1);
+
+    nstrides = 0;
+    for (size_t stride = min_stride; stride <= max_stride; stride *= 2)
+        nstrides++;
+
+    latency = malloc(max_lines * nstrides * sizeof(*latency));
+    EXPECT_ERRNO(latency != NULL);
+
+    /* Use huge pages to make sure that the virtual and physical
+     * index bits match for all strides up to the huge page size. */
+    data_size = max_stride * max_lines;
+    data = mem_huge_alloc(data_size);
+    EXPECT_ERRNO(data != NULL);
+    mem_touch(data, data_size, 1);
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 's':
+        min_stride = argp_parse_size(state, "minimum stride", arg);
+        break;
+
+    case 'S':
+        max_stride = argp_parse_size(state, "maximum stride", arg);
+        break;
+
+    case 'k':
+        max_lines = argp_parse_uint(state, "lines", arg);
+        if (max_lines < 2 || max_lines > 4096)
+            argp_error(state, "Invalid number of lines: Must be between "
+                       "2 and 4096.\n");
+        break;
+
+    case 'n':
+        accesses = argp_parse_uint64(state, "accesses", arg);
+        if (!accesses)
+            argp_error(state, "Invalid number of accesses.\n");
+        break;
+
+    case 'R':
+        repeat = argp_parse_uint(state, "repetitions", arg);
+        if (!repeat)
+            argp_error(state, "Invalid number of repetitions.\n");
+        break;
+
+    case 'j':
+        jump = argp_parse_double(state, "jump", arg);
+        if (jump <= 0.0)
+            argp_error(state, "Invalid jump: Must be positive.\n");
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        if (min_stride < sizeof(void *) || (min_stride & (min_stride - 1)))
+            argp_error(state, "Invalid minimum stride: Must be a power "
+                       "of two.\n");
+        if (max_stride < min_stride)
+            argp_error(state, "Invalid maximum stride: Must not be "
+                       "smaller than the minimum stride.\n");
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "assoc";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "min-stride", 's', "SIZE", 0, "Minimum stride (default: 1 KiB)", 0 },
+    { "max-stride", 'S', "SIZE", 0, "Maximum stride (default: 1 MiB)", 0 },
+    { "lines", 'k', "NUM", 0,
+      "Maximum number of lines (default: 32)", 0 },
+    { "accesses", 'n', "NUM", 0,
+      "Accesses per measurement (default: 1000000)", 0 },
+    { "repeat", 'R', "NUM", 0,
+      "Repetitions per measurement, the minimum is reported "
+      "(default: 5)", 0 },
+    { "jump", 'j', "PCT", 0,
+      "Latency increase (in percent) reported as a conflict "
+      "(default: 30)", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Cache set conflicts and associativity"
+    "\v"
+    "This microbenchmark chases pointers through K lines separated by a "
+    "power-of-two stride, in random order. K is swept from 1 to the "
+    "maximum number of lines and the stride from the minimum to the "
+    "maximum stride. When the stride is a multiple of a cache's size "
+    "divided by its number of ways, all lines map to the same set and "
+    "the latency jumps once K exceeds the associativity. The jumps are "
+    "reported for every stride. The buffer is allocated using huge "
+    "pages, so the virtual and physical index bits match for strides "
+    "up to the huge page size.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    bench_param("Minimum stride", "%zu", min_stride);
+    bench_param("Maximum stride", "%zu", max_stride);
+    bench_param("Lines", "%u", max_lines);
+    bench_param("Accesses", "%" PRIu64, accesses);
+
+    run();
+    report();
+
+    mem_huge_free(data, data_size);
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "expect.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "bench_common.h"
+
+typedef uint64_t (*op_func_t)(uint64_t *v, uint64_t count);
+
+#define OP_LOOP(name, op)                               \
+    static uint64_t __attribute__((noinline))           \
+    name(uint64_t *v, uint64_t count)                   \
+    {                                                   \
+        uint64_t acc = 0;                               \
+        for (uint64_t i = 0; i < count; i++) {          \
+            op;                                         \
+        }                                               \
+        return acc;                                     \
+    }
+
+/* lock xadd on x86 */
+OP_LOOP(op_xadd,
+        acc += __atomic_fetch_add(v, 1, __ATOMIC_SEQ_CST))
+
+/* lock cmpxchg loop on x86, acc counts failed attempts */
+OP_LOOP(op_cmpxchg,
+        uint64_t old = __atomic_load_n(v, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(v, &old, old + 1, 0,
+                                            __ATOMIC_SEQ_CST,
+                                            __ATOMIC_RELAXED))
+            acc++)
+
+/* xchg (implicitly locked) on x86 */
+OP_LOOP(op_xchg,
+        acc += __atomic_exchange_n(v, i, __ATOMIC_SEQ_CST))
+
+/* Plain mov from memory */
+OP_LOOP(op_load,
+        acc += __atomic_load_n(v, __ATOMIC_RELAXED))
+
+/* Plain mov to memory */
+OP_LOOP(op_store,
+        __atomic_store_n(v, i, __ATOMIC_RELAXED))
+
+static const struct {
+    const char *name;
+    op_func_t func;
+} ops[] = {
+    { "xadd", op_xadd },
+    { "cmpxchg", op_cmpxchg },
+    { "xchg", op_xchg },
+    { "load", op_load },
+    { "store", op_store },
+    { NULL, NULL }
+};
+
+typedef enum {
+    /** All threads access the same variable */
+    LAYOUT_SHARED = 0,
+    /** Threads access distinct variables in the same line */
+    LAYOUT_FALSE,
+    /** Threads access variables in distinct lines */
+    LAYOUT_PADDED,
+} layout_t;
+
+static const char *layout_names[] = {
+    "shared", "false", "padded", NULL
+};
+
+typedef struct {
+    int cpu;
+    unsigned int id;
+    pthread_t thread;
+
+    uint64_t cycles;
+    double time;
+    uint64_t sink;
+} worker_t;
+
+static uint64_t op_count = 1000000;
+static int sel_op = -1;
+static int sel_layout = -1;
+
+static char *data;
+static size_t data_size;
+
+static worker_t *workers;
+static unsigned int nworkers;
+static pthread_barrier_t start_barrier;
+static pthread_barrier_t done_barrier;
+
+/* Current measurement point, written by the main thread between
+ * barriers. */
+static struct {
+    op_func_t func;
+    layout_t layout;
+    unsigned int threads;
+    int quit;
+} point;
+
+static uint64_t *
+variable(layout_t layout, unsigned int id)
+{
+    const size_t line_size = bench_settings.line_size;
+    const size_t per_line = line_size / sizeof(uint64_t);
+
+    switch (layout) {
+    case LAYOUT_SHARED:
+        return (uint64_t *)data;
+    case LAYOUT_FALSE:
+        return (uint64_t *)(data + (id / per_line) * line_size) +
+            id % per_line;
+    case LAYOUT_PADDED:
+    default:
+        return (uint64_t *)(data + id * line_size);
+    }
+}
+
+static void *
+worker_main(void *arg)
+{
+    worker_t *w = arg;
+
+    EXPECT_ERRNO(bench_pin_thread(w->cpu) != -1);
+
+    while (1) {
+        pthread_barrier_wait(&start_barrier);
+        if (point.quit)
+            break;
+
+        if (w->id < point.threads) {
+            uint64_t *v = variable(point.layout, w->id);
+            uint64_t start;
+            timing_t t;
+
+            timing_init(&t);
+            timing_start(&t);
+            start = cycles_get();
+            w->sink += point.func(v, op_count);
+            w->cycles = cycles_get() - start;
+            timing_stop(&t);
+            w->time = t.acc;
+        }
+
+        pthread_barrier_wait(&done_barrier);
+    }
+
+    return NULL;
+}
+
+static void
+measure(int op, layout_t layout, unsigned int threads)
+{
+    double throughput = 0.0;
+    double latency = 0.0;
+
+    memset(data, 0, data_size);
+    point.func = ops[op].func;
+    point.layout = layout;
+    point.threads = threads;
+
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&done_barrier);
+
+    for (unsigned int i = 0; i < threads; i++) {
+        throughput += op_count / workers[i].time;
+        latency += (double)workers[i].cycles / op_count;
+    }
+
+    printf("%-8s %-8s %7u %12.2f %10.1f\n",
+           ops[op].name, layout_names[layout], threads,
+           throughput * 1E-6, latency / threads);
+}
+
+static void
+init()
+{
+    nworkers = bench_settings.ncpus;
+    workers = calloc(nworkers, sizeof(*workers));
+    EXPECT_ERRNO(workers != NULL);
+
+    data_size = nworkers * bench_settings.line_size;
+    EXPECT(posix_memalign((void **)&data, bench_settings.line_size,
+                          data_size) == 0);
+
+    EXPECT(pthread_barrier_init(&start_barrier, NULL, nworkers + 1) == 0);
+    EXPECT(pthread_barrier_init(&done_barrier, NULL, nworkers + 1) == 0);
+    for (unsigned int i = 0; i < nworkers; i++) {
+        worker_t *w = &workers[i];
+
+        w->cpu = bench_settings.cpus[i];
+        w->id = i;
+        EXPECT(pthread_create(&w->thread, NULL, worker_main, w) == 0);
+    }
+}
+
+static void
+run()
+{
+    printf("%-8s %-8s %7s %12s %10s\n",
+           "Op", "Layout", "Threads", "Mops/s", "Cycles/op");
+
+    for (int op = 0; ops[op].name; op++) {
+        if (sel_op != -1 && sel_op != op)
+            continue;
+
+        for (int layout = 0; layout_names[layout]; layout++) {
+            if (sel_layout != -1 && sel_layout != layout)
+                continue;
+
+            for (unsigned int threads = 1; threads <= nworkers; threads++)
+                measure(op, layout, threads);
+        }
+    }
+
+    point.quit = 1;
+    pthread_barrier_wait(&start_barrier);
+    for (unsigned int i = 0; i < nworkers; i++)
+        EXPECT(pthread_join(workers[i].thread, NULL) == 0);
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'n':
+        op_count = argp_parse_uint64(state, "operations", arg);
+        break;
+
+    case 'o':
+        for (sel_op = 0; ops[sel_op].name; sel_op++) {
+            if (!strcmp(ops[sel_op].name, arg))
+                break;
+        }
+        if (!ops[sel_op].name)
+            argp_error(state, "Invalid operation: '%s'.\n", arg);
+        break;
+
+    case 'l':
+        for (sel_layout = 0; layout_names[sel_layout]; sel_layout++) {
+            if (!strcmp(layout_names[sel_layout], arg))
+                break;
+        }
+        if (!layout_names[sel_layout])
+            argp_error(state, "Invalid layout: '%s'.\n", arg);
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "atomics";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "ops", 'n', "NUM", 0,
+      "Operations per thread and measurement (default: 1000000)", 0 },
+    { "op", 'o', "NAME", 0,
+      "Only measure xadd, cmpxchg, xchg, load or store", 0 },
+    { "layout", 'l', "NAME", 0,
+      "Only measure the shared, false or padded layout", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Measure contention on atomic operations"
+    "\v"
+    "This microbenchmark runs locked and plain memory operations on "
+    "variables that are either shared by all threads (shared), packed into "
+    "the same cache line (false sharing) or placed in separate cache lines "
+    "(padded). The number of threads is swept from one to the number of CPUs "
+    "in the CPU list, thread N runs on the Nth CPU in the list. The "
+    "throughput of all threads and the average latency of an operation are "
+    "reported for every combination.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    printf("Operations: %" PRIu64 "\n", op_count);
+    printf("Threads: %u\n", nworkers);
+    bench_param_placement();
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+
+#include "expect.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "rnd_lcg.h"
+#include "cyclecounter.h"
+#include "bench_common.h"
+
+#define MAX_SITES 1024
+#define MAX_TARGETS 64
+
+/* Misprediction rate below which a pattern is considered learned */
+#define LEARNED 0.05
+
+typedef enum {
+    MODE_PERIOD = 0,
+    MODE_SITES,
+    MODE_INDIRECT,
+} sweep_t;
+
+static const char *mode_names[] = { "period", "sites", "indirect", NULL };
+
+static int mode_mask = -1;
+static size_t nbranches = 4 * 1024 * 1024;
+static size_t max_period = 64 * 1024;
+static size_t period = 16;
+static double noise = 0.0;
+static uint64_t seed = 42ULL;
+static unsigned int repeat = 3;
+
+static uint8_t *stream;
+
+/**
+ * Generate outcomes for a number of branch sites
+ *
+ * Every site repeats its own random pattern of values in [0, values)
+ * with the given period. The sites consume consecutive entries of the
+ * stream. Each outcome is replaced by a random value with a
+ * probability equal to the noise.
+ */
+static void
+gen_stream(size_t n, unsigned int sites, size_t period, unsigned int values)
+{
+    uint64_t lcg_state = seed;
+
+    for (size_t i = 0; i < n; i++) {
+        const unsigned int site = i % sites;
+        const size_t t = i / sites;
+        const uint64_t key = (uint64_t)site * period + t % period;
+        uint64_t value = rnd_lcg64(key ^ seed);
+
+        /* The LCG is linear, mix the bits to break up the patterns
+         * between consecutive keys. */
+        value = rnd_lcg64(value ^ (value >> 29));
+        value ^= value >> 32;
+
+        if (noise > 0.0) {
+            lcg_state = rnd_lcg64(lcg_state);
+            if ((lcg_state >> 11) * 0x1.0p-53 < noise) {
+                lcg_state = rnd_lcg64(lcg_state);
+                value = lcg_state >> 32;
+            }
+        }
+
+        stream[i] = (value >> 16) % values;
+    }
+}
+
+/* Every site falls through to the next one. The attribute has to be
+ * used since fall through comments don't survive macro expansion. */
+#define SITE(n)                                                         \
+    case n:                                                             \
+        if (*o++)                                                       \
+            asm volatile("nop");                                        \
+        __attribute__((fallthrough));
+#define SITES2(n) SITE(n) SITE(n + 1)
+#define SITES4(n) SITES2(n) SITES2(n + 2)
+#define SITES8(n) SITES4(n) SITES4(n + 4)
+#define SITES16(n) SITES8(n) SITES8(n + 8)
+#define SITES32(n) SITES16(n) SITES16(n + 16)
+#define SITES64(n) SITES32(n) SITES32(n + 32)
+#define SITES128(n) SITES64(n) SITES64(n + 64)
+#define SITES256(n) SITES128(n) SITES128(n + 128)
+#define SITES512(n) SITES256(n) SITES256(n + 256)
+#define SITES1024(n) SITES512(n) SITES512(n + 512)
+
+/**
+ * Execute n conditional branches spread over a number of sites
+ *
+ * Jumping into the unrolled sites makes every round execute the last
+ * sites branches, n must be a multiple of sites.
+ */
+static void
+run_sites(const uint8_t *o, size_t n, unsigned int sites)
+{
+    const uint8_t *end = o + n;
+
+    while (o < end) {
+        switch (MAX_SITES - sites) {
+            SITES1024(0)
+        default:
+            break;
+        }
+    }
+}
+
+#define TARGETS(X)                                                      \
+    X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7)                             \
+    X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15)                       \
+    X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23)                     \
+    X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31)                     \
+    X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39)                     \
+    X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47)                     \
+    X(48) X(49) X(50) X(51) X(52) X(53) X(54) X(55)                     \
+    X(56) X(57) X(58) X(59) X(60) X(61) X(62) X(63)
+
+#define TARGET_LABEL(n) &&target_ ## n,
+#define TARGET(n)                                                       \
+    target_ ## n:                                                       \
+        acc += n;                                                       \
+        if (o == end)                                                   \
+            return acc;                                                 \
+        goto *labels[*o++];
+
+/**
+ * Execute n indirect branches using threaded dispatch
+ *
+ * Every target ends with its own indirect jump, like the dispatch
+ * loop of an interpreter. Crossjumping would merge the dispatch code
+ * of the targets into a single indirect jump, so it is disabled.
+ */
+static uint64_t __attribute__((noinline, optimize("no-crossjumping")))
+run_indirect(const uint8_t *o, size_t n)
+{
+    static void * const labels[MAX_TARGETS] = { TARGETS(TARGET_LABEL) };
+    const uint8_t *end = o + n;
+    uint64_t acc = 0;
+
+    goto *labels[*o++];
+    TARGETS(TARGET)
+}
+
+static volatile uint64_t indirect_sink;
+
+/**
+ * Run the generated stream
+ *
+ * @return Minimum number of cycles per branch over all repetitions
+ */
+static double
+measure(sweep_t mode, size_t n, unsigned int sites)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (unsigned int r = 0; r <= repeat; r++) {
+        const uint64_t start = cycles_get();
+        uint64_t cycles;
+
+        if (mode == MODE_INDIRECT)
+            indirect_sink = run_indirect(stream, n - 1);
+        else
+            run_sites(stream, n, sites);
+        cycles = cycles_get() - start;
+
+        /* The first run trains the predictors and is not measured */
+        if (r && cycles < best)
+            best = cycles;
+    }
+
+    return (double)best / n;
+}
+
+/**
+ * Measure the cost of a mispredicted conditional branch
+ *
+ * @param base Cycles per predictable branch
+ * @return Misprediction penalty in cycles
+ */
+static double
+measure_penalty(double *base)
+{
+    double rnd;
+
+    /* Run the predictable case twice to let the CPU ramp up its
+     * frequency before it is used as the baseline. */
+    memset(stream, 1, nbranches);
+    measure(MODE_SITES, nbranches, 1);
+    *base = measure(MODE_SITES, nbranches, 1);
+
+    gen_stream(nbranches, 1, nbranches, 2);
+    rnd = measure(MODE_SITES, nbranches, 1);
+
+    printf("Predictable branch: %.2f cycles\n", *base);
+    printf("Random branch: %.2f cycles\n", rnd);
+    /* Half of the random branches are mispredicted */
+    printf("Misprediction penalty: %.2f cycles\n", (rnd - *base) * 2);
+
+    return (rnd - *base) * 2;
+}
+
+static void
+run_period(double base, double penalty)
+{
+    size_t learned = 0;
+
+    printf("\n%8s %14s %10s\n", "Period", "Cycles/branch", "Miss rate");
+    for (size_t p = 1; p <= max_period; p *= 2) {
+        const double c = (gen_stream(nbranches, 1, p, 2),
+                          measure(MODE_SITES, nbranches, 1));
+        const double miss = penalty > 0.0 ? (c - base) / penalty : 0.0;
+
+        printf("%8zu %14.2f %10.3f\n", p, c, miss);
+        if (miss < LEARNED && learned == p / 2)
+            learned = p;
+    }
+    printf("Longest learned period: %zu\n", learned);
+}
+
+static void
+run_sites_sweep(double penalty)
+{
+    unsigned int learned = 0;
+
+    printf("\n%8s %14s %10s\n", "Sites", "Cycles/branch", "Miss rate");
+    for (unsigned int s = 1; s <= MAX_SITES; s *= 2) {
+        const size_t n = nbranches - nbranches % s;
+        double base, c, miss;
+
+        /* The loop overhead is amortized over the sites, use always
+         * taken branches with the same number of sites as the
+         * baseline. */
+        memset(stream, 1, n);
+        base = measure(MODE_SITES, n, s);
+
+        gen_stream(n, s, period, 2);
+        c = measure(MODE_SITES, n, s);
+        miss = penalty > 0.0 ? (c - base) / penalty : 0.0;
+
+        printf("%8u %14.2f %10.3f\n", s, c, miss);
+        if (miss < LEARNED && learned == s / 2)
+            learned = s;
+    }
+    printf("Most learned sites: %u\n", learned);
+}
+
+static void
+run_indirect_sweep()
+{
+    double single = 0.0, rnd = 0.0;
+    unsigned int t;
+
+    printf("\n%8s %14s %14s\n", "Targets", "Periodic", "Random");
+    for (t = 1; t <= MAX_TARGETS; t *= 2) {
+        double periodic;
+
+        gen_stream(nbranches, 1, period, t);
+        periodic = measure(MODE_INDIRECT, nbranches, 1);
+        gen_stream(nbranches, 1, nbranches, t);
+        rnd = measure(MODE_INDIRECT, nbranches, 1);
+        if (t == 1)
+            single = rnd;
+
+        printf("%8u %14.2f %14.2f\n", t, periodic, rnd);
+    }
+
+    /* A random target is mispredicted with probability 1 - 1/t */
+    t = MAX_TARGETS;
+    printf("Indirect misprediction penalty: %.2f cycles\n",
+           (rnd - single) / (1.0 - 1.0 / t));
+}
+
+static void
+run()
+{
+    double base, penalty;
+
+    penalty = measure_penalty(&base);
+
+    if (mode_mask & (1 << MODE_PERIOD))
+        run_period(base, penalty);
+    if (mode_mask & (1 << MODE_SITES))
+        run_sites_sweep(penalty);
+    if (mode_mask & (1 << MODE_INDIRECT))
+        run_indirect_sweep();
+}
+
+static void
+init()
+{
+    EXPECT_ERRNO(bench_pin_cpu() != -1);
+
+    stream = malloc(nbranches);
+    EXPECT_ERRNO(stream != NULL);
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'm':
+        if (!strcmp(arg, "all")) {
+            mode_mask = -1;
+        } else {
+            int i;
+
+            for (i = 0; mode_names[i] && strcmp(arg, mode_names[i]); i++)
+                ;
+            if (!mode_names[i])
+                argp_error(state, "Invalid mode: %s\n", arg);
+            mode_mask = 1 << i;
+        }
+        break;
+
+    case 'n':
+        nbranches = argp_parse_size(state, "branches", arg);
+        if (nbranches < MAX_SITES)
+            argp_error(state, "Invalid number of branches: Must be at "
+                       "least %i.\n", MAX_SITES);
+        break;
+
+    case 'P':
+        max_period = argp_parse_size(state, "maximum period", arg);
+        break;
+
+    case 'p':
+        period = argp_parse_size(state, "period", arg);
+        if (!period)
+            argp_error(state, "Invalid period: Must not be 0.\n");
+        break;
+
+    case 'r':
+        noise = argp_parse_double(state, "randomness", arg) / 100.0;
+        if (noise < 0.0 || noise > 1.0)
+            argp_error(state, "Invalid randomness: Must be between 0 "
+                       "and 100.\n");
+        break;
+
+    case 's':
+        seed = argp_parse_uint64(state, "random seed", arg);
+        break;
+
+    case 'R':
+        repeat = argp_parse_uint(state, "repetitions", arg);
+        if (!repeat)
+            argp_error(state, "Invalid number of repetitions.\n");
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "branch";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "mode", 'm', "MODE", 0,
+      "Sweep: period, sites, indirect or all (default: all)", 0 },
+    { "branches", 'n', "NUM", 0,
+      "Branches per measurement (default: 4 Mi)", 0 },
+    { "max-period", 'P', "NUM", 0,
+      "Maximum pattern period in the period sweep (default: 65536)", 0 },
+    { "period", 'p', "NUM", 0,
+      "Pattern period in the sites and indirect sweeps (default: 16)", 0 },
+    { "randomness", 'r', "PCT", 0,
+      "Probability (in percent) that an outcome is replaced by a "
+      "random one (default: 0)", 0 },
+    { "random-seed", 's', "NUM", 0, "Random seed", 0 },
+    { "repeat", 'R', "NUM", 0,
+      "Repetitions per measurement, the minimum is reported "
+      "(default: 3)", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Branch predictor capacity and misprediction cost"
+    "\v"
+    "This microbenchmark executes conditional and indirect branches "
+    "whose outcomes are read from a precomputed stream. Each branch "
+    "site repeats a random pattern with a configurable period, and a "
+    "configurable fraction of the outcomes is replaced by random ones. "
+    "The misprediction penalty is derived from the difference between "
+    "a predictable and a random branch. The period sweep shows the "
+    "longest pattern a single branch can learn (history length), the "
+    "sites sweep how many branches with a periodic pattern can be "
+    "tracked at the same time, and the indirect sweep the cost of "
+    "threaded dispatch over a number of targets.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    bench_param("Branches", "%zu", nbranches);
+    bench_param("Period", "%zu", period);
+    bench_param("Randomness", "%g%%", noise * 100.0);
+    bench_param("Seed", "%" PRIu64, seed);
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
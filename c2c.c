@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <pthread.h>
+#include <math.h>
+
+#include "expect.h"
+#include "cpu.h"
+#include "rnd_lcg.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "bench_common.h"
+
+/* Round trips before the timed part of a measurement */
+#define WARMUP_ROUNDS 100
+
+typedef struct {
+    unsigned int from;
+    unsigned int to;
+} pair_t;
+
+static unsigned int samples = 1000;
+static unsigned int repeat = 3;
+static double gap = 1.25;
+static uint64_t rnd_state = 42ULL;
+
+/* The line that is bounced between the two CPUs */
+static struct {
+    volatile uint64_t value;
+} __attribute__((aligned(128))) line;
+
+static unsigned int ncpus;
+/* One-way latency matrix, ncpus x ncpus */
+static double *latency;
+
+static void
+wait_for(uint64_t value)
+{
+    while (line.value != value)
+        cpu_relax();
+}
+
+static void *
+responder_main(void *arg)
+{
+    const int cpu = *(int *)arg;
+
+    EXPECT_ERRNO(bench_pin_thread(cpu) != -1);
+
+    for (uint64_t i = 0; i < WARMUP_ROUNDS + samples; i++) {
+        wait_for(2 * i + 1);
+        line.value = 2 * i + 2;
+    }
+
+    return NULL;
+}
+
+/**
+ * Measure the one-way cache line transfer latency between two CPUs
+ *
+ * The initiator writes an odd value to the line and waits for the
+ * responder to write the following even value. The round trip is
+ * timed on the initiator only, so the cycle counters of the two CPUs
+ * do not need to be synchronized.
+ */
+static double
+measure(int from, int to)
+{
+    pthread_t responder;
+    uint64_t start = 0;
+    uint64_t cycles;
+
+    line.value = 0;
+    EXPECT_ERRNO(bench_pin_thread(from) != -1);
+    EXPECT(pthread_create(&responder, NULL, responder_main, &to) == 0);
+
+    for (uint64_t i = 0; i < WARMUP_ROUNDS + samples; i++) {
+        if (i == WARMUP_ROUNDS)
+            start = cycles_get();
+        line.value = 2 * i + 1;
+        wait_for(2 * i + 2);
+    }
+    cycles = cycles_get() - start;
+
+    EXPECT(pthread_join(responder, NULL) == 0);
+
+    return (double)cycles / samples / 2;
+}
+
+static void
+shuffle(pair_t *pairs, size_t count)
+{
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j;
+        pair_t tmp;
+
+        rnd_state = rnd_lcg64(rnd_state);
+        j = (rnd_state >> 16) % (i + 1);
+        tmp = pairs[i];
+        pairs[i] = pairs[j];
+        pairs[j] = tmp;
+    }
+}
+
+static void
+measure_all()
+{
+    const size_t count = ncpus * (ncpus - 1);
+    pair_t *pairs;
+    size_t k = 0;
+
+    pairs = malloc(count * sizeof(*pairs));
+    EXPECT_ERRNO(pairs != NULL);
+    for (unsigned int i = 0; i < ncpus; i++) {
+        for (unsigned int j = 0; j < ncpus; j++) {
+            if (i != j) {
+                pairs[k].from = i;
+                pairs[k].to = j;
+                k++;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < ncpus * ncpus; i++)
+        latency[i] = INFINITY;
+
+    /* Keep the best of several passes over the pairs, each pass in a
+     * new random order to avoid systematic bias from thermal effects
+     * and scheduling noise. */
+    for (unsigned int r = 0; r < repeat; r++) {
+        shuffle(pairs, count);
+        for (size_t p = 0; p < count; p++) {
+            const unsigned int i = pairs[p].from;
+            const unsigned int j = pairs[p].to;
+            const double l = measure(bench_settings.cpus[i],
+                                     bench_settings.cpus[j]);
+
+            if (l < latency[i * ncpus + j])
+                latency[i * ncpus + j] = l;
+        }
+    }
+
+    free(pairs);
+}
+
+static void
+print_matrix()
+{
+    printf("%5s", "");
+    for (unsigned int j = 0; j < ncpus; j++)
+        printf(" %6i", bench_settings.cpus[j]);
+    printf("\n");
+
+    for (unsigned int i = 0; i < ncpus; i++) {
+        printf("%5i", bench_settings.cpus[i]);
+        for (unsigned int j = 0; j < ncpus; j++) {
+            if (i == j)
+                printf(" %6s", "-");
+            else
+                printf(" %6.0f", latency[i * ncpus + j]);
+        }
+        printf("\n");
+    }
+}
+
+static double
+symmetric(unsigned int i, unsigned int j)
+{
+    return (latency[i * ncpus + j] + latency[j * ncpus + i]) / 2;
+}
+
+static unsigned int
+find(unsigned int *parent, unsigned int i)
+{
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+    const double da = *(const double *)a;
+    const double db = *(const double *)b;
+
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/**
+ * Print groups of CPUs that communicate faster than each latency tier
+ *
+ * The symmetric latencies are sorted and split into tiers wherever a
+ * latency is more than gap times larger than the previous one. For
+ * every tier, the CPUs are grouped using single linkage clustering:
+ * two CPUs end up in the same group if they are connected by a chain
+ * of pairs within the tier's latency. On typical systems the tiers
+ * correspond to SMT siblings, core complexes, dies and sockets.
+ */
+static void
+print_clusters()
+{
+    const size_t count = ncpus * (ncpus - 1) / 2;
+    unsigned int *parent;
+    double *values;
+    size_t k = 0;
+
+    values = malloc(count * sizeof(*values));
+    parent = malloc(ncpus * sizeof(*parent));
+    EXPECT_ERRNO(values != NULL && parent != NULL);
+
+    for (unsigned int i = 0; i < ncpus; i++) {
+        for (unsigned int j = i + 1; j < ncpus; j++)
+            values[k++] = symmetric(i, j);
+    }
+    qsort(values, count, sizeof(*values), compare_double);
+
+    for (size_t t = 0; t < count; t++) {
+        const double threshold = values[t];
+
+        if (t + 1 < count && values[t + 1] <= threshold * gap)
+            continue;
+
+        for (unsigned int i = 0; i < ncpus; i++)
+            parent[i] = i;
+        for (unsigned int i = 0; i < ncpus; i++) {
+            for (unsigned int j = i + 1; j < ncpus; j++) {
+                if (symmetric(i, j) <= threshold)
+                    parent[find(parent, j)] = find(parent, i);
+            }
+        }
+
+        printf("Clusters <= %.0f cycles:", threshold);
+        for (unsigned int i = 0; i < ncpus; i++) {
+            const char *sep = " [";
+
+            if (find(parent, i) != i)
+                continue;
+            for (unsigned int j = 0; j < ncpus; j++) {
+                if (find(parent, j) == i) {
+                    printf("%s%i", sep, bench_settings.cpus[j]);
+                    sep = ",";
+                }
+            }
+            printf("]");
+        }
+        printf("\n");
+    }
+
+    free(parent);
+    free(values);
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'n':
+        samples = argp_parse_uint(state, "samples", arg);
+        if (!samples)
+            argp_error(state, "Invalid samples: Must be at least 1.\n");
+        break;
+
+    case 'R':
+        repeat = argp_parse_uint(state, "repetitions", arg);
+        if (!repeat)
+            argp_error(state, "Invalid repetitions: Must be at least 1.\n");
+        break;
+
+    case 'g':
+        gap = argp_parse_double(state, "gap", arg);
+        if (gap < 1.0)
+            argp_error(state, "Invalid gap: Must be at least 1.\n");
+        break;
+
+    case 'r':
+        rnd_state = argp_parse_uint64(state, "random seed", arg);
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "c2c";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "samples", 'n', "NUM", 0,
+      "Round trips per measurement (default: 1000)", 0 },
+    { "repeat", 'R', "NUM", 0,
+      "Measure every pair NUM times and keep the best (default: 3)", 0 },
+    { "gap", 'g', "RATIO", 0,
+      "Latency ratio that separates two cluster tiers (default: 1.25)", 0 },
+    { "random-seed", 'r', "NUM", 0, "Random seed for the pair order", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Measure core-to-core cache line transfer latency"
+    "\v"
+    "This microbenchmark measures the one-way latency of moving a cache line "
+    "between every ordered pair of CPUs in the CPU list by bouncing a line "
+    "between two pinned threads. The pairs are measured in a random order "
+    "and every pair is measured several times. The result is printed as a "
+    "matrix with the sending CPU on the rows, followed by groups of CPUs "
+    "with similar latencies.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    ncpus = bench_settings.ncpus;
+    if (ncpus < 2) {
+        fprintf(stderr, "At least two CPUs are needed.\n");
+        return 1;
+    }
+
+    latency = malloc(ncpus * ncpus * sizeof(*latency));
+    EXPECT_ERRNO(latency != NULL);
+
+    printf("Samples: %u\n", samples);
+    printf("Repetitions: %u\n", repeat);
+    bench_param_placement();
+
+    measure_all();
+    print_matrix();
+    print_clusters();
+
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "expect.h"
+#include "memory.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "bench_common.h"
+
+/* Approximate number of bytes copied per measurement */
+#define BYTES_PER_MEASUREMENT (64 * 1024 * 1024)
+
+typedef void (*copy_func_t)(void *dst, const void *src, size_t n);
+
+static void __attribute__((noinline))
+copy_memcpy(void *dst, const void *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+static void __attribute__((noinline))
+copy_memmove(void *dst, const void *src, size_t n)
+{
+    memmove(dst, src, n);
+}
+
+#if defined(__x86_64__)
+
+static void __attribute__((noinline))
+copy_movsb(void *dst, const void *src, size_t n)
+{
+    asm volatile ("rep movsb"
+                  : "+D"(dst), "+S"(src), "+c"(n)
+                  :
+                  : "memory");
+}
+
+static void __attribute__((noinline, target("avx")))
+copy_avx(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+
+    for (; n >= 128; n -= 128, s += 128, d += 128) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)s);
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+        const __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+
+        _mm256_storeu_si256((__m256i *)d, a);
+        _mm256_storeu_si256((__m256i *)(d + 32), b);
+        _mm256_storeu_si256((__m256i *)(d + 64), c);
+        _mm256_storeu_si256((__m256i *)(d + 96), e);
+    }
+    memcpy(d, s, n);
+}
+
+static void __attribute__((noinline, target("avx")))
+copy_nt(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    const size_t head = -(uintptr_t)d & 31;
+
+    /* Streaming stores need an aligned destination */
+    if (head >= n) {
+        memcpy(d, s, n);
+        return;
+    }
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    for (; n >= 128; n -= 128, s += 128, d += 128) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)s);
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+        const __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+
+        _mm256_stream_si256((__m256i *)d, a);
+        _mm256_stream_si256((__m256i *)(d + 32), b);
+        _mm256_stream_si256((__m256i *)(d + 64), c);
+        _mm256_stream_si256((__m256i *)(d + 96), e);
+    }
+    _mm_sfence();
+    memcpy(d, s, n);
+}
+
+static int
+have_avx()
+{
+    return __builtin_cpu_supports("avx");
+}
+
+#endif
+
+static int
+always()
+{
+    return 1;
+}
+
+static const struct {
+    const char *name;
+    copy_func_t func;
+    int (*supported)();
+    /** Set for kernels that are also used for the crossover point */
+    int temporal;
+    /** Set for kernels that handle overlapping buffers */
+    int overlap;
+} kernels[] = {
+    { "memcpy", copy_memcpy, always, 1, 0 },
+    { "memmove", copy_memmove, always, 1, 1 },
+#if defined(__x86_64__)
+    { "movsb", copy_movsb, always, 1, 0 },
+    { "avx", copy_avx, have_avx, 1, 0 },
+    { "nt", copy_nt, have_avx, 0, 0 },
+#endif
+    { NULL, NULL, NULL, 0, 0 }
+};
+
+#define MAX_KERNELS (sizeof(kernels) / sizeof(*kernels))
+
+static size_t min_size = 16;
+static size_t max_size = 0;
+static size_t src_offset = 0;
+static size_t dst_offset = 0;
+static long overlap = 0;
+static unsigned int repeat = 3;
+static int sel_kernel = -1;
+
+static char *buf_src;
+static char *buf_dst;
+static size_t buf_size;
+static char *src;
+static char *dst;
+
+static int
+enabled(int k)
+{
+    if (sel_kernel != -1 && sel_kernel != k)
+        return 0;
+    if (overlap && !kernels[k].overlap)
+        return 0;
+    return kernels[k].supported();
+}
+
+/**
+ * Measure the bandwidth of a copy kernel
+ *
+ * @return Best bandwidth in bytes per second
+ */
+static double
+measure(copy_func_t func, size_t size)
+{
+    uint64_t reps = BYTES_PER_MEASUREMENT / size;
+    double best = 0.0;
+
+    if (reps < 1)
+        reps = 1;
+
+    for (unsigned int r = 0; r < repeat; r++) {
+        timing_t t;
+
+        timing_init(&t);
+        timing_start(&t);
+        for (uint64_t i = 0; i < reps; i++) {
+            func(dst, src, size);
+            asm volatile ("" ::: "memory");
+        }
+        timing_stop(&t);
+
+        if (reps * size / t.acc > best)
+            best = reps * size / t.acc;
+    }
+
+    return best;
+}
+
+static void
+run()
+{
+    size_t crossover = 0;
+    int k_count = 0;
+
+    printf("%12s", "Size");
+    for (int k = 0; kernels[k].name; k++) {
+        if (enabled(k)) {
+            printf(" %9s", kernels[k].name);
+            k_count++;
+        }
+    }
+    printf("  (GB/s)\n");
+
+    /* Sizes are powers of two and the points half way between them */
+    for (size_t base = min_size; base <= max_size; base *= 2) {
+        const size_t steps[2] = { base, base + base / 2 };
+
+        for (int s = 0; s < 2 && steps[s] <= max_size; s++) {
+            const size_t size = steps[s];
+            double best_temporal = 0.0;
+            double best_nt = 0.0;
+
+            printf("%12zu", size);
+            for (int k = 0; kernels[k].name; k++) {
+                double bw;
+
+                if (!enabled(k))
+                    continue;
+
+                bw = measure(kernels[k].func, size);
+                printf(" %9.2f", bw * 1E-9);
+                fflush(stdout);
+
+                if (kernels[k].temporal && bw > best_temporal)
+                    best_temporal = bw;
+                else if (!kernels[k].temporal && bw > best_nt)
+                    best_nt = bw;
+            }
+            printf("\n");
+
+            /* Remember the smallest size from which non-temporal
+             * copies win for all larger sizes */
+            if (best_nt > best_temporal && best_temporal > 0.0) {
+                if (!crossover)
+                    crossover = size;
+            } else {
+                crossover = 0;
+            }
+        }
+    }
+
+    if (crossover)
+        printf("Non-temporal crossover: %zu\n", crossover);
+    else if (k_count > 1)
+        printf("Non-temporal crossover: none\n");
+}
+
+static void
+init()
+{
+    const size_t span = overlap < 0 ? -overlap : overlap;
+
+    if (!max_size)
+        max_size = 4 * bench_settings.cache_shared;
+
+    EXPECT_ERRNO(bench_pin_cpu() != -1);
+
+    if (overlap) {
+        /* Copy within one buffer, the destination is overlap bytes
+         * after (or before) the source */
+        buf_size = max_size + span + src_offset + dst_offset;
+        buf_src = buf_dst = mem_huge_alloc(buf_size);
+        EXPECT_ERRNO(buf_src != NULL);
+        src = buf_src + src_offset + (overlap < 0 ? span : 0);
+        dst = src + overlap + dst_offset;
+    } else {
+        buf_size = max_size + src_offset + dst_offset;
+        buf_src = mem_huge_alloc(buf_size);
+        buf_dst = mem_huge_alloc(buf_size);
+        EXPECT_ERRNO(buf_src != NULL && buf_dst != NULL);
+        src = buf_src + src_offset;
+        dst = buf_dst + dst_offset;
+    }
+
+    for (size_t i = 0; i < buf_size; i++) {
+        buf_src[i] = i & 0xFF;
+        buf_dst[i] = 0;
+    }
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'm':
+        min_size = argp_parse_size(state, "minimum size", arg);
+        if (!min_size)
+            argp_error(state, "Invalid minimum size: Must not be 0.\n");
+        break;
+
+    case 's':
+        max_size = argp_parse_size(state, "maximum size", arg);
+        break;
+
+    case 'S':
+        src_offset = argp_parse_size(state, "source offset", arg);
+        break;
+
+    case 'D':
+        dst_offset = argp_parse_size(state, "destination offset", arg);
+        break;
+
+    case 'o':
+        overlap = argp_parse_long(state, "overlap", arg);
+        break;
+
+    case 'R':
+        repeat = argp_parse_uint(state, "repetitions", arg);
+        if (!repeat)
+            argp_error(state, "Invalid repetitions: Must be at least 1.\n");
+        break;
+
+    case 'k':
+        for (sel_kernel = 0; kernels[sel_kernel].name; sel_kernel++) {
+            if (!strcmp(kernels[sel_kernel].name, arg))
+                break;
+        }
+        if (!kernels[sel_kernel].name)
+            argp_error(state, "Invalid kernel: '%s'.\n", arg);
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "copy";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "min-size", 'm', "SIZE", 0, "Smallest copy size (default: 16)", 0 },
+    { "max-size", 's', "SIZE", 0,
+      "Largest copy size (default: 4x the shared cache)", 0 },
+    { "src-offset", 'S', "NUM", 0, "Misalign the source by NUM bytes", 0 },
+    { "dst-offset", 'D', "NUM", 0,
+      "Misalign the destination by NUM bytes", 0 },
+    { "overlap", 'o', "NUM", 0,
+      "Copy within one buffer with the destination NUM bytes after the "
+      "source (negative for before), only memmove is measured", 0 },
+    { "repeat", 'R', "NUM", 0,
+      "Measure NUM times and keep the best (default: 3)", 0 },
+    { "kernel", 'k', "NAME", 0,
+      "Only measure memcpy, memmove, movsb, avx or nt", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Measure memory copy bandwidth"
+    "\v"
+    "This microbenchmark measures the bandwidth of glibc memcpy and memmove, "
+    "rep movsb, an unrolled AVX copy and an AVX copy using non-temporal "
+    "stores for copy sizes from the minimum size to the maximum size. Each "
+    "size is copied repeatedly between the same buffers, so small copies "
+    "run from the cache. After the table, the smallest size from which the "
+    "non-temporal copy is faster than all other kernels is reported.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    bench_param("Maximum size", "%zu", max_size);
+    bench_param("Source offset", "%zu", src_offset);
+    bench_param("Destination offset", "%zu", dst_offset);
+    if (overlap)
+        bench_param("Overlap", "%li", overlap);
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "expect.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "access.h"
+#include "rnd_lcg.h"
+#include "bench_common.h"
+
+#define ACCESS access_rd8
+
+typedef enum {
+    PATTERN_STREAM = 0,
+    PATTERN_RANDOM,
+} pattern_t;
+
+static const char *pattern_names[] = { "stream", "random" };
+
+typedef enum {
+    MMAP_PLAIN = 0,
+    MMAP_POPULATE,
+    MMAP_WILLNEED,
+    PREAD,
+} method_t;
+
+static const char *method_names[] = {
+    "mmap", "mmap+populate", "mmap+willneed", "pread"
+};
+
+static size_t bench_size = 256 * 1024 * 1024;
+static size_t block_size = 64 * 1024;
+static const char *file_name = NULL;
+static uint64_t seed = 42ULL;
+
+static int fd = -1;
+static char *buffer;
+static uint32_t *line_order;
+static uint32_t *block_order;
+static char temp_name[] = "fileio.XXXXXX";
+static int temp_created = 0;
+
+/**
+ * Create a random permutation of the numbers 0 to n-1
+ *
+ * Random patterns visit every line or block once in this order, which
+ * makes them read as much data as the stream pattern.
+ */
+static uint32_t *
+shuffle(size_t n)
+{
+    uint32_t *order = malloc(n * sizeof(*order));
+    uint64_t lcg_state = seed;
+
+    EXPECT_ERRNO(order != NULL);
+    EXPECT(n <= UINT32_MAX);
+    for (size_t i = 0; i < n; i++)
+        order[i] = i;
+
+    for (size_t i = n - 1; i > 0; i--) {
+        const size_t j = (lcg_state = rnd_lcg64(lcg_state)) % (i + 1);
+        const uint32_t tmp = order[i];
+
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    return order;
+}
+
+/**
+ * Touch every line in a buffer
+ */
+static inline void
+consume(const char *data, size_t size)
+{
+    const size_t line_size = bench_settings.line_size;
+
+    for (size_t i = 0; i < size; i += line_size)
+        ACCESS(data + i);
+}
+
+/**
+ * Access the file through a mapping
+ *
+ * @return Number of accesses
+ */
+static uint64_t
+run_mmap(method_t method, pattern_t pattern)
+{
+    const size_t line_size = bench_settings.line_size;
+    const size_t lines = (bench_size + line_size - 1) / line_size;
+    char *data;
+
+    data = mmap(NULL, bench_size, PROT_READ,
+                MAP_SHARED | (method == MMAP_POPULATE ? MAP_POPULATE : 0),
+                fd, 0);
+    EXPECT_ERRNO(data != MAP_FAILED);
+
+    if (method == MMAP_WILLNEED)
+        EXPECT_ERRNO(madvise(data, bench_size, MADV_WILLNEED) == 0);
+
+    switch (pattern) {
+    case PATTERN_STREAM:
+        consume(data, bench_size);
+        break;
+
+    case PATTERN_RANDOM:
+        for (size_t i = 0; i < lines; i++)
+            ACCESS(data + line_order[i] * line_size);
+        break;
+    }
+
+    EXPECT_ERRNO(munmap(data, bench_size) == 0);
+
+    return lines;
+}
+
+/**
+ * Read the file into a buffer one block at a time
+ *
+ * @return Number of blocks read
+ */
+static uint64_t
+run_pread(pattern_t pattern)
+{
+    const size_t blocks = bench_size / block_size;
+
+    for (size_t i = 0; i < blocks; i++) {
+        const size_t block = pattern == PATTERN_RANDOM ? block_order[i] : i;
+
+        EXPECT_ERRNO(pread(fd, buffer, block_size, block * block_size) ==
+                     block_size);
+        consume(buffer, block_size);
+    }
+
+    return blocks;
+}
+
+static void
+drop_cache()
+{
+    EXPECT(posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0);
+}
+
+static void
+warm_cache()
+{
+    for (off_t off = 0; off < bench_size; off += block_size)
+        EXPECT_ERRNO(pread(fd, buffer, block_size, off) == block_size);
+}
+
+static void
+measure(method_t method, pattern_t pattern, int cold)
+{
+    uint64_t accesses;
+    timing_t t;
+
+    if (cold)
+        drop_cache();
+    else
+        warm_cache();
+
+    timing_init(&t);
+    timing_start(&t);
+    if (method == PREAD)
+        accesses = run_pread(pattern);
+    else
+        accesses = run_mmap(method, pattern);
+    timing_stop(&t);
+
+    printf("%-14s %-7s %-5s %10.4f %8.3f %12.0f\n",
+           method_names[method], pattern_names[pattern],
+           cold ? "cold" : "hot", t.acc, bench_size / t.acc * 1E-9,
+           accesses / t.acc);
+}
+
+static void
+run()
+{
+    printf("%-14s %-7s %-5s %10s %8s %12s\n",
+           "Method", "Pattern", "Cache", "Time", "GB/s", "Accesses/s");
+
+    for (int cold = 0; cold < 2; cold++) {
+        for (pattern_t p = PATTERN_STREAM; p <= PATTERN_RANDOM; p++) {
+            for (method_t m = MMAP_PLAIN; m <= PREAD; m++)
+                measure(m, p, cold);
+        }
+    }
+}
+
+static void
+cleanup()
+{
+    if (temp_created)
+        unlink(temp_name);
+}
+
+static void
+init()
+{
+    bench_size -= bench_size % block_size;
+    if (!bench_size)
+        bench_size = block_size;
+
+    EXPECT_ERRNO(bench_pin_cpu() != -1);
+
+    buffer = malloc(block_size);
+    EXPECT_ERRNO(buffer != NULL);
+    line_order = shuffle((bench_size + bench_settings.line_size - 1) /
+                         bench_settings.line_size);
+    block_order = shuffle(bench_size / block_size);
+
+    if (file_name) {
+        fd = open(file_name, O_RDWR | O_CREAT, 0600);
+    } else {
+        fd = mkstemp(temp_name);
+        temp_created = fd != -1;
+        atexit(cleanup);
+        file_name = temp_name;
+    }
+    EXPECT_ERRNO(fd != -1);
+
+    /* Fill the file with data and make sure that it reaches the disk,
+     * dirty pages can't be dropped from the page cache. */
+    for (size_t i = 0; i < block_size; i++)
+        buffer[i] = i & 0xFF;
+    for (off_t off = 0; off < bench_size; off += block_size)
+        EXPECT_ERRNO(pwrite(fd, buffer, block_size, off) == block_size);
+    EXPECT_ERRNO(fsync(fd) == 0);
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 's':
+        bench_size = argp_parse_size(state, "size", arg);
+        break;
+
+    case 'b':
+        block_size = argp_parse_size(state, "block size", arg);
+        if (!block_size)
+            argp_error(state, "Invalid block size: Must not be 0.\n");
+        break;
+
+    case 'f':
+        file_name = arg;
+        break;
+
+    case 'r':
+        seed = argp_parse_uint64(state, "random seed", arg);
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "fileio";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "size", 's', "SIZE", 0, "File size (default: 256 MiB)", 0 },
+    { "block", 'b', "SIZE", 0,
+      "pread block size (default: 64 KiB)", 0 },
+    { "file", 'f', "FILE", 0,
+      "Use FILE instead of a temporary file in the current directory, "
+      "the file is overwritten", 0 },
+    { "random-seed", 'r', "NUM", 0, "Random seed", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Compare file-backed mmap with pread"
+    "\v"
+    "This microbenchmark reads a file using the block (stream) and random "
+    "access patterns, either through a shared mapping of the file or by "
+    "reading blocks into a reusable buffer using pread. Mappings are used "
+    "as they are, with MAP_POPULATE or with madvise(MADV_WILLNEED). Every "
+    "combination is measured with the file in the page cache (hot) and "
+    "after dropping it using posix_fadvise(POSIX_FADV_DONTNEED) (cold). "
+    "The mapping is created and removed inside the timed region. Both "
+    "patterns read the whole file, the random pattern visits lines or "
+    "blocks in a random order.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    printf("File: %s\n", file_name);
+    bench_param("Data size", "%zu", bench_size);
+    bench_param("Block size", "%zu", block_size);
+    bench_param("Seed", "%" PRIu64, seed);
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
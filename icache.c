@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "expect.h"
+#include "memory.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "rnd_lcg.h"
+#include "cyclecounter.h"
+#include "bench_common.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_CODEGEN 1
+#endif
+
+#define OP_JMP_REL32 0xE9
+#define OP_CALL_REL32 0xE8
+#define OP_RET 0xC3
+#define REL32_SIZE 5
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* 5-byte NOP: nopl 0x0(%rax,%rax,1) */
+static const uint8_t nop5[] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+
+typedef enum {
+    CHAIN_JUMP = 0,
+    CHAIN_CALL,
+} chain_t;
+
+static const char *chain_names[] = { "jump", "call", NULL };
+
+static const struct {
+    const char *name;
+    mem_page_t type;
+} types[] = {
+    { "4k", MEM_PAGE_SMALL },
+    { "thp", MEM_PAGE_THP },
+    { "hugetlb", MEM_PAGE_HUGETLB },
+    { NULL, 0 }
+};
+
+static chain_t chain = CHAIN_JUMP;
+static int type = 1;
+static size_t min_size = 4 * 1024;
+static size_t max_size = 64 * 1024 * 1024;
+static size_t block_size = 64;
+static unsigned int nops = 0;
+static int sequential = 0;
+static unsigned int repeat = 10;
+static double jump = 30.0;
+
+static uint8_t *code;
+static size_t code_size;
+static size_t *order;
+
+typedef void (*code_func_t)();
+
+static uint8_t *
+emit_rel32(uint8_t *p, uint8_t op, const uint8_t *target)
+{
+    const int32_t rel = (int32_t)(target - (p + REL32_SIZE));
+
+    *p++ = op;
+    memcpy(p, &rel, sizeof(rel));
+    return p + sizeof(rel);
+}
+
+static uint8_t *
+emit_nops(uint8_t *p)
+{
+    for (unsigned int i = 0; i < nops; i++) {
+        memcpy(p, nop5, sizeof(nop5));
+        p += sizeof(nop5);
+    }
+    return p;
+}
+
+/**
+ * Generate a chain of blocks covering size bytes
+ *
+ * Jump chains link the blocks with direct jumps, the last block
+ * returns. Call chains consist of blocks that return immediately and
+ * a driver, placed after the last block, that calls every block in
+ * order.
+ *
+ * @return Entry point of the generated code
+ */
+static code_func_t
+generate(size_t size)
+{
+    const size_t blocks = size / block_size;
+    uint64_t lcg_state = 42ULL;
+    uint8_t *entry;
+
+    EXPECT_ERRNO(mprotect(code, code_size, PROT_READ | PROT_WRITE) == 0);
+
+    for (size_t i = 0; i < blocks; i++)
+        order[i] = i;
+    if (!sequential) {
+        /* Shuffle all but the first block, which is the entry point
+         * of jump chains. */
+        for (size_t i = blocks - 1; i > 1; i--) {
+            size_t j, tmp;
+
+            lcg_state = rnd_lcg64(lcg_state);
+            j = 1 + (lcg_state >> 16) % i;
+            tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+
+    for (size_t i = 0; i < blocks; i++) {
+        uint8_t *p = emit_nops(code + order[i] * block_size);
+
+        if (chain == CHAIN_JUMP && i + 1 < blocks)
+            emit_rel32(p, OP_JMP_REL32, code + order[i + 1] * block_size);
+        else
+            *p = OP_RET;
+    }
+
+    if (chain == CHAIN_CALL) {
+        uint8_t *p;
+
+        entry = p = code + max_size;
+        for (size_t i = 0; i < blocks; i++)
+            p = emit_rel32(p, OP_CALL_REL32, code + order[i] * block_size);
+        *p = OP_RET;
+    } else
+        entry = code;
+
+    EXPECT_ERRNO(mprotect(code, code_size, PROT_READ | PROT_EXEC) == 0);
+    __builtin___clear_cache((char *)code, (char *)code + code_size);
+
+    return (code_func_t)entry;
+}
+
+/**
+ * Run the code for a footprint
+ *
+ * @return Minimum number of cycles per block over all repetitions
+ */
+static double
+measure(size_t size)
+{
+    const code_func_t func = generate(size);
+    const size_t blocks = size / block_size;
+    uint64_t best = UINT64_MAX;
+
+    /* The first run warms the caches and TLBs and is not measured */
+    func();
+    for (unsigned int r = 0; r < repeat; r++) {
+        const uint64_t start = cycles_get();
+        uint64_t cycles;
+
+        func();
+        cycles = cycles_get() - start;
+        if (cycles < best)
+            best = cycles;
+    }
+
+    return (double)best / blocks;
+}
+
+static void
+run()
+{
+    double prev = 0.0;
+
+    printf("%10s %9s %12s %10s\n",
+           "Footprint", "Blocks", "Cycles/block", "Cycles/KiB");
+    for (size_t size = min_size; size <= max_size; size *= 2) {
+        const double cycles = measure(size);
+
+        printf("%10zu %9zu %12.2f %10.1f",
+               size, size / block_size, cycles,
+               cycles * 1024 / block_size);
+        if (prev > 0.0 && cycles > prev * (1.0 + jump / 100.0))
+            printf("  <- cliff");
+        printf("\n");
+        prev = cycles;
+    }
+}
+
+static void
+init()
+{
+    const size_t driver_size = (max_size / block_size) * REL32_SIZE + 1;
+
+    EXPECT_ERRNO(bench_pin_cpu() != -1);
+
+    order = malloc((max_size / block_size) * sizeof(*order));
+    EXPECT_ERRNO(order != NULL);
+
+    /* Keep the mapping a multiple of the huge page size, mprotect
+     * can't split hugetlb mappings. */
+    code_size = max_size + driver_size;
+    code_size = (code_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    /* The code is written before it is run, which populates the
+     * mapping without requiring MADV_POPULATE_WRITE for THP */
+    code = mem_alloc(code_size, types[type].type, 0);
+    if (!code) {
+        fprintf(stderr, "Failed to allocate %s pages: %s\n",
+                types[type].name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int
+parse_name(struct argp_state *state, const char *name, const char *arg,
+           const char **names)
+{
+    for (int i = 0; names[i]; i++) {
+        if (!strcmp(arg, names[i]))
+            return i;
+    }
+
+    argp_error(state, "Invalid %s: %s\n", name, arg);
+    return -1;
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'm':
+        chain = parse_name(state, "chain", arg, chain_names);
+        break;
+
+    case 't': {
+        int i;
+
+        for (i = 0; types[i].name && strcmp(arg, types[i].name); i++)
+            ;
+        if (!types[i].name)
+            argp_error(state, "Invalid page type: %s\n", arg);
+        type = i;
+    } break;
+
+    case 's':
+        min_size = argp_parse_size(state, "minimum footprint", arg);
+        break;
+
+    case 'S':
+        max_size = argp_parse_size(state, "maximum footprint", arg);
+        break;
+
+    case 'b':
+        block_size = argp_parse_size(state, "block size", arg);
+        break;
+
+    case 'N':
+        nops = argp_parse_uint(state, "NOPs", arg);
+        break;
+
+    case 'o':
+        sequential = 1;
+        break;
+
+    case 'R':
+        repeat = argp_parse_uint(state, "repetitions", arg);
+        if (!repeat)
+            argp_error(state, "Invalid number of repetitions.\n");
+        break;
+
+    case 'j':
+        jump = argp_parse_double(state, "jump", arg);
+        if (jump <= 0.0)
+            argp_error(state, "Invalid jump: Must be positive.\n");
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        if (block_size < (size_t)nops * sizeof(nop5) + REL32_SIZE)
+            argp_error(state, "Invalid block size: Too small for %u "
+                       "NOPs and a branch.\n", nops);
+        if (min_size < block_size || max_size < min_size)
+            argp_error(state, "Invalid footprint: The minimum footprint "
+                       "must be between the block size and the maximum "
+                       "footprint.\n");
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "icache";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "chain", 'm', "TYPE", 0,
+      "Chain type: jump or call (default: jump)", 0 },
+    { "type", 't', "NAME", 0,
+      "Pages backing the code: 4k, thp or hugetlb (default: thp)", 0 },
+    { "min-size", 's', "SIZE", 0,
+      "Minimum code footprint (default: 4 KiB)", 0 },
+    { "max-size", 'S', "SIZE", 0,
+      "Maximum code footprint (default: 64 MiB)", 0 },
+    { "block-size", 'b', "SIZE", 0,
+      "Distance between blocks (default: 64)", 0 },
+    { "nops", 'N', "NUM", 0,
+      "5-byte NOPs at the start of every block (default: 0)", 0 },
+    { "sequential", 'o', NULL, 0,
+      "Execute blocks in address order instead of random order", 0 },
+    { "repeat", 'R', "NUM", 0,
+      "Repetitions per footprint, the minimum is reported "
+      "(default: 10)", 0 },
+    { "jump", 'j', "PCT", 0,
+      "Increase in cycles per block (in percent) reported as a cliff "
+      "(default: 30)", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Instruction cache and iTLB footprint"
+    "\v"
+    "This microbenchmark generates code into an executable mapping and "
+    "measures the time to execute it. The code consists of blocks, "
+    "spaced by the block size, that are linked by direct jumps or "
+    "called one by one from a driver. The blocks are executed in random "
+    "order unless --sequential is given, which spreads the control flow "
+    "across cache lines and pages. The footprint is swept in powers of "
+    "two to show where the L1 instruction cache, the decoded uop cache, "
+    "L2 and the instruction TLB run out. Code generation is only "
+    "supported on x86.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+#ifndef HAVE_CODEGEN
+    fprintf(stderr, "Code generation is not supported on this "
+            "architecture.\n");
+    return 1;
+#else
+    init();
+
+    bench_param("Chain", "%s", chain_names[chain]);
+    bench_param("Page type", "%s", types[type].name);
+    bench_param("Block size", "%zu", block_size);
+    bench_param("NOPs", "%u", nops);
+    bench_param("Order", "%s", sequential ? "sequential" : "random");
+
+    run();
+
+    mem_free(code, code_size, types[type].type);
+    return 0;
+#endif
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -29,9 +29,12 @@
  */
 
 #include "argp_utils.h"
+#include "topology.h"
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
+#include <errno.h>
 #include <argp.h>
 
 long long
@@ -52,6 +55,42 @@ argp_parse_long_long(struct argp_state *state,
     return value;
 }
 
+double
+argp_parse_double(struct argp_state *state,
+		  const char *name, const char *arg)
+{
+    char *endptr;
+    double value;
+
+    errno = 0;
+    value = strtod(arg, &endptr);
+    if (errno)
+        argp_failure(state, EXIT_FAILURE, errno,
+                     "Invalid %s", name);
+    else if (*arg == '\0' || *endptr != '\0')
+        argp_error(state, "Invalid %s: '%s' is not a number.\n", name, arg);
+
+    return value;
+}
+
+unsigned int
+argp_parse_cpu_list(struct argp_state *state,
+		    const char *name, const char *arg, int **cpus)
+{
+    const int count = topology_parse_cpu_list(arg, cpus);
+
+    if (count == -1) {
+        if (errno == EINVAL)
+            argp_error(state, "Invalid %s: '%s' is not a CPU list.\n",
+                       name, arg);
+        else
+            argp_failure(state, EXIT_FAILURE, errno, "Invalid %s", name);
+    } else if (!count)
+        argp_error(state, "Invalid %s: Empty CPU list.\n", name);
+
+    return count;
+}
+
 #define PARSE_INTTYPEX(type, fname, min, max)				\
     type								\
     argp_parse_ ## fname(struct argp_state *state,			\
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "baseline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/*
+ * Record format (tab separated):
+ *   program config samples mean stddev min max [provenance]
+ */
+
+int
+baseline_save(const char *file, const char *program, const char *config,
+              const char *provenance, const stats_t *s)
+{
+    FILE *fp;
+    int ret;
+
+    fp = fopen(file, "a");
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "%s\t%s\t%" PRIu64 "\t%.17g\t%.17g\t%.17g\t%.17g",
+            program, config, s->n, s->mean, stats_stddev(s), s->min, s->max);
+    if (provenance)
+        fprintf(fp, "\t%s", provenance);
+    fputc('\n', fp);
+
+    ret = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0)
+        ret = -1;
+
+    return ret;
+}
+
+int
+baseline_load(const char *file, const char *program, const char *config,
+              stats_t *s)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t line_len = 0;
+    int found = 0;
+
+    fp = fopen(file, "r");
+    if (!fp)
+        return -1;
+
+    while (getline(&line, &line_len, fp) != -1) {
+        char *save;
+        char *l_program, *l_config, *l_stats;
+        uint64_t n;
+        double mean, stddev, min, max;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        l_program = strtok_r(line, "\t", &save);
+        l_config = strtok_r(NULL, "\t", &save);
+        l_stats = strtok_r(NULL, "\n", &save);
+        if (!l_program || !l_config || !l_stats ||
+            strcmp(l_program, program) || strcmp(l_config, config))
+            continue;
+
+        if (sscanf(l_stats, "%" SCNu64 "%lf%lf%lf%lf",
+                   &n, &mean, &stddev, &min, &max) != 5)
+            continue;
+
+        s->n = n;
+        s->mean = mean;
+        s->m2 = n > 1 ? stddev * stddev * (n - 1) : 0.0;
+        s->min = min;
+        s->max = max;
+        found = 1;
+    }
+
+    free(line);
+    fclose(fp);
+
+    return found;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
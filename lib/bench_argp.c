@@ -28,43 +28,221 @@
  * OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE
+
 #include "bench_argp.h"
 #include "argp_utils.h"
+#include "provenance.h"
+#include "cyclecounter.h"
+#include "cpu.h"
+#include "access.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
 
 enum {
     KEY_CACHE_PRIVATE = -1,
     KEY_CACHE_SHARED = -2,
     KEY_LINE_SIZE = -3,
+    KEY_SAVE = -4,
+    KEY_COMPARE = -5,
+    KEY_THRESHOLD = -6,
+    KEY_INTERVAL = -7,
+    KEY_CYCLE_COUNTER = -8,
+    KEY_PLACEMENT = -9,
+    KEY_FREQ_TOLERANCE = -10,
+    KEY_FREQ_REJECT = -11,
+    KEY_QUIET_SYSTEM = -12,
+    KEY_FIFO = -13,
+    KEY_RETRIES = -14,
+    KEY_CACHE_STATE = -15,
+    KEY_ACCESS_WIDTH = -16,
+    KEY_STORE = -17,
+    KEY_MISALIGN = -18,
+};
+
+const char *bench_cache_state_names[] = {
+    "warm",
+    "cold",
+    "llc-only",
+    NULL
 };
 
 static struct argp_option options[] = {
     { NULL, 0, NULL, 0, "Ubench common:", 1 },
     { "cpu", 'c', "CPU", 0, "Pin to CPU", 1 },
+    { "cpus", 'C', "LIST", 0,
+      "Run threads on the CPUs in LIST, e.g. 0,2,4-7 (default: all "
+      "CPUs the process may run on)", 1 },
+    { "placement", KEY_PLACEMENT, "POLICY", 0,
+      "Order the CPUs in --cpus: list (as given), compact (fill cores, "
+      "then packages), scatter (round-robin across packages and cores) "
+      "or core (one thread per physical core) (default: list)", 1 },
     { "iterations", 'i', "NUM", 0, "Run NUM iterations, 0 for unbounded", 1 },
+    { "cache-state", KEY_CACHE_STATE, "STATE", 0,
+      "Cache state at the start of each iteration: warm (default), "
+      "cold or llc-only", 1 },
+    { "interval", KEY_INTERVAL, "MS", 0,
+      "Report progress every MS milliseconds in unbounded runs "
+      "(default: 1000, 0 to disable)", 1 },
+
+    { "cycle-counter", KEY_CYCLE_COUNTER, "NAME", 0,
+      "Cycle counter backend: native, clock or perf", 1 },
 
     { NULL, 0, NULL, 0, "Cache settings:", 2 },
     { "cache-pri", KEY_CACHE_PRIVATE, "SIZE", 0, "Shared cache size", 2 },
     { "cache-sha", KEY_CACHE_SHARED, "SIZE", 0, "Shared cache size", 2 },
     { "line-size", KEY_LINE_SIZE, "SIZE", 0, "Line size", 2 },
 
+    { NULL, 0, NULL, 0, "Baseline comparison:", 3 },
+    { "save", KEY_SAVE, "FILE", 0, "Append results to baseline FILE", 3 },
+    { "compare", KEY_COMPARE, "FILE", 0,
+      "Compare results against baseline FILE, fail on regressions", 3 },
+    { "threshold", KEY_THRESHOLD, "PCT", 0,
+      "Report changes larger than PCT percent (default: 5)", 3 },
+
+    { NULL, 0, NULL, 0, "Frequency guard:", 4 },
+    { "freq-tolerance", KEY_FREQ_TOLERANCE, "PCT", 0,
+      "Flag runs where the effective frequency varied more than PCT "
+      "percent (default: 5, 0 to disable)", 4 },
+    { "freq-reject", KEY_FREQ_REJECT, NULL, 0,
+      "Fail runs that were flagged by the frequency guard", 4 },
+
+    { NULL, 0, NULL, 0, "Memory accesses:", 5 },
+    { "access-width", KEY_ACCESS_WIDTH, "BYTES", 0,
+      "Access BYTES bytes at a time: 1, 2, 4, 8, 16, 32 or 64 "
+      "(default: 1)", 5 },
+    { "store", KEY_STORE, NULL, 0, "Store instead of load", 5 },
+    { "misalign", KEY_MISALIGN, "BYTES", 0,
+      "Access BYTES bytes into each line. Accesses that extend past the "
+      "end of a line split across lines, use a line size of 4096 to "
+      "split every access across pages (default: 0)", 5 },
+
+    { NULL, 0, NULL, 0, "Noise isolation:", 6 },
+    { "quiet-system", KEY_QUIET_SYSTEM, NULL, 0,
+      "Lock and pre-fault memory and flag runs that were interrupted by "
+      "context switches or page faults", 6 },
+    { "fifo", KEY_FIFO, "PRIO", 0,
+      "Run under SCHED_FIFO at priority PRIO (implies --quiet-system)", 6 },
+    { "retries", KEY_RETRIES, "NUM", 0,
+      "Retry contaminated runs up to NUM times (implies --quiet-system)",
+      6 },
+
     { 0 }
 };
 
+int bench_argp_run_bench = 0;
+
+/**
+ * Reject an option that only affects RUN_BENCH if the benchmark
+ * doesn't use it
+ */
+static void
+require_run_bench(struct argp_state *state, int key)
+{
+    if (bench_argp_run_bench)
+        return;
+
+    for (const struct argp_option *o = options; o->name || o->doc; o++) {
+        if (o->name && o->key == key)
+            argp_error(state, "--%s isn't supported by this benchmark.\n",
+                       o->name);
+    }
+}
+
 static error_t
 parse_opt(int key, char *arg, struct argp_state *state)
 {
+    switch (key) {
+    case KEY_SAVE:
+    case KEY_COMPARE:
+    case KEY_THRESHOLD:
+    case KEY_FREQ_TOLERANCE:
+    case KEY_FREQ_REJECT:
+    case KEY_QUIET_SYSTEM:
+    case KEY_FIFO:
+    case KEY_RETRIES:
+    case KEY_CACHE_STATE:
+    case KEY_ACCESS_WIDTH:
+    case KEY_STORE:
+    case KEY_MISALIGN:
+        require_run_bench(state, key);
+        break;
+    }
+
     switch (key) {
     case 'c':
         bench_settings.cpu = argp_parse_int(state, "cpu", arg);
 	break;
 
+    case 'C':
+        bench_settings.ncpus =
+            argp_parse_cpu_list(state, "CPU list", arg, &bench_settings.cpus);
+	break;
+
+    case KEY_PLACEMENT: {
+        int i;
+
+        for (i = 0; topology_policy_names[i]; i++) {
+            if (!strcmp(arg, topology_policy_names[i]))
+                break;
+        }
+        if (!topology_policy_names[i])
+            argp_error(state, "Invalid placement policy: %s\n", arg);
+        bench_settings.placement = i;
+    } break;
+
     case 'i':
         bench_settings.iterations =
             argp_parse_uint(state, "iterations", arg);
 	break;
 
+    case KEY_CACHE_STATE: {
+        int i;
+
+        for (i = 0; bench_cache_state_names[i]; i++) {
+            if (!strcmp(arg, bench_cache_state_names[i]))
+                break;
+        }
+        if (!bench_cache_state_names[i])
+            argp_error(state, "Invalid cache state: %s\n", arg);
+#ifndef CPU_HAVE_FLUSH
+        if (i == BENCH_CACHE_COLD)
+            argp_error(state, "Cache flushing isn't supported on this "
+                       "architecture.\n");
+#endif
+        bench_settings.cache_state = i;
+    } break;
+
+    case KEY_ACCESS_WIDTH:
+        bench_settings.access_width =
+            argp_parse_size(state, "access width", arg);
+        if (!access_supported(bench_settings.access_width))
+            argp_error(state, "Unsupported access width: %zu\n",
+                       bench_settings.access_width);
+	break;
+
+    case KEY_STORE:
+        bench_settings.access_store = 1;
+	break;
+
+    case KEY_MISALIGN:
+        bench_settings.access_offset =
+            argp_parse_size(state, "misalignment", arg);
+	break;
+
+    case KEY_INTERVAL:
+        bench_settings.interval = argp_parse_uint(state, "interval", arg);
+	break;
+
+    case KEY_CYCLE_COUNTER:
+        if (cycles_select(arg) == -1)
+            argp_failure(state, EXIT_FAILURE, errno,
+                         "Can't use cycle counter '%s'", arg);
+	break;
+
     case KEY_CACHE_PRIVATE:
         bench_settings.cache_private =
             argp_parse_size(state, "private cache size", arg);
@@ -80,9 +258,100 @@ parse_opt(int key, char *arg, struct argp_state *state)
             argp_parse_size(state, "line size", arg);
 	break;
 
-    case ARGP_KEY_END:
-        break;
-     
+    case KEY_SAVE:
+        bench_settings.baseline_save = arg;
+	break;
+
+    case KEY_COMPARE:
+        bench_settings.baseline_compare = arg;
+	break;
+
+    case KEY_THRESHOLD:
+        bench_settings.threshold = argp_parse_double(state, "threshold", arg);
+        if (bench_settings.threshold < 0)
+            argp_error(state, "Invalid threshold: Must not be negative.\n");
+	break;
+
+    case KEY_FREQ_TOLERANCE:
+        bench_settings.freq_tolerance =
+            argp_parse_double(state, "frequency tolerance", arg);
+        if (bench_settings.freq_tolerance < 0)
+            argp_error(state, "Invalid frequency tolerance: Must not be "
+                       "negative.\n");
+	break;
+
+    case KEY_FREQ_REJECT:
+        bench_settings.freq_reject = 1;
+	break;
+
+    case KEY_QUIET_SYSTEM:
+        bench_settings.quiet = 1;
+	break;
+
+    case KEY_FIFO: {
+        const int min = sched_get_priority_min(SCHED_FIFO);
+        const int max = sched_get_priority_max(SCHED_FIFO);
+
+        bench_settings.fifo_priority = argp_parse_int(state, "priority", arg);
+        if (bench_settings.fifo_priority < min ||
+            bench_settings.fifo_priority > max)
+            argp_error(state, "Invalid priority: Must be in the range "
+                       "[%i, %i].\n", min, max);
+        bench_settings.quiet = 1;
+    } break;
+
+    case KEY_RETRIES:
+        bench_settings.retries = argp_parse_uint(state, "retries", arg);
+        bench_settings.quiet = 1;
+	break;
+
+    case ARGP_KEY_END: {
+        cpu_set_t cpu_set;
+        int count;
+
+        if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == -1)
+            argp_failure(state, EXIT_FAILURE, errno,
+                         "Failed to get CPU affinity");
+
+        if (!bench_settings.ncpus) {
+            bench_settings.cpus = malloc(CPU_COUNT(&cpu_set) * sizeof(int));
+            if (!bench_settings.cpus)
+                argp_failure(state, EXIT_FAILURE, errno, "malloc");
+            for (int i = 0; i < CPU_SETSIZE; i++) {
+                if (CPU_ISSET(i, &cpu_set))
+                    bench_settings.cpus[bench_settings.ncpus++] = i;
+            }
+        } else {
+            for (unsigned int i = 0; i < bench_settings.ncpus; i++) {
+                const int cpu = bench_settings.cpus[i];
+
+                if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &cpu_set))
+                    argp_error(state, "CPU %i is not in the allowed "
+                               "cpuset.\n", cpu);
+            }
+        }
+
+        if (bench_settings.cpu != -1 &&
+            (bench_settings.cpu >= CPU_SETSIZE ||
+             !CPU_ISSET(bench_settings.cpu, &cpu_set)))
+            argp_error(state, "CPU %i is not in the allowed cpuset.\n",
+                       bench_settings.cpu);
+
+        if (bench_settings.access_offset >= bench_settings.line_size)
+            argp_error(state, "Invalid misalignment: Must be smaller than "
+                       "the line size.\n");
+
+        count = topology_place(bench_settings.placement,
+                               bench_settings.cpus, bench_settings.ncpus);
+        if (count == -1)
+            argp_failure(state, EXIT_FAILURE, errno,
+                         "Failed to apply placement policy");
+        bench_settings.ncpus = count;
+
+        provenance_collect();
+        provenance_print(stdout);
+    } break;
+
     default:
         return ARGP_ERR_UNKNOWN;
     }
@@ -96,10 +365,26 @@ struct argp bench_argp = {
 
 bench_settings_t bench_settings = {
     .cpu = -1,
+    .cpus = NULL,
+    .ncpus = 0,
+    .placement = TOPOLOGY_LIST,
     .iterations = 1000,
+    .cache_state = BENCH_CACHE_WARM,
+    .interval = 1000,
     .cache_private = (32 + 256) * 1024,
     .cache_shared = 12 * 1024 * 1024,
     .line_size = 64,
+    .access_width = 1,
+    .access_store = 0,
+    .access_offset = 0,
+    .baseline_save = NULL,
+    .baseline_compare = NULL,
+    .threshold = 5.0,
+    .freq_tolerance = 5.0,
+    .freq_reject = 0,
+    .quiet = 0,
+    .fifo_priority = 0,
+    .retries = 0,
 };
 
 /*
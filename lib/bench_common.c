@@ -33,23 +33,570 @@
 #include "bench_common.h"
 
 #include <sched.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include "expect.h"
+#include "baseline.h"
+#include "provenance.h"
+#include "memory.h"
+#include "cpu.h"
+
+/* Significance level used when comparing against a baseline */
+#define BASELINE_ALPHA 0.05
+
+/* Number of back-to-back counter reads used to find the overhead */
+#define OVERHEAD_SAMPLES 10000
+
+/* Amount of stack pre-faulted in quiet mode */
+#define QUIET_STACK_SIZE (256 * 1024)
+
+/* Size of the eviction buffer relative to the private caches. Walking
+ * more than the cache size compensates for non-LRU replacement. */
+#define EVICT_FACTOR 2
+
+/* Cache line size used when the system doesn't report one */
+#define DEFAULT_HW_LINE_SIZE 64
+
+volatile sig_atomic_t bench_stop = 0;
+uint64_t bench_progress = 0;
+
+static char bench_config[1024] = "";
+
+static uint64_t work_accesses = 0;
+static uint64_t work_bytes = 0;
+
+static const char *cache_data = NULL;
+static size_t cache_data_size = 0;
+static char *cache_evict = NULL;
+static size_t cache_evict_size = 0;
+static size_t cache_line_size = DEFAULT_HW_LINE_SIZE;
+static int cache_flushopt = 0;
+
+static pthread_t interval_thread;
+static int interval_running = 0;
+
+static int quiet_ready = 0;
+static struct rusage quiet_before;
+static struct rusage quiet_delta;
+static int quiet_contaminated = 0;
+static unsigned int quiet_attempts = 0;
 
 int
 bench_pin_cpu()
 {
-    if (bench_settings.cpu != -1) {
-	cpu_set_t cpu_set;
+    if (bench_settings.cpu != -1)
+        return bench_pin_thread(bench_settings.cpu);
+
+    return 0;
+}
+
+int
+bench_pin_thread(int cpu)
+{
+    cpu_set_t cpu_set;
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set);
+}
+
+uint64_t
+bench_timer_overhead()
+{
+    static uint64_t overhead = UINT64_MAX;
+
+    if (overhead == UINT64_MAX) {
+        for (int i = 0; i < OVERHEAD_SAMPLES; i++) {
+            const uint64_t start = cycles_get();
+            const uint64_t delta = cycles_get() - start;
+
+            if (delta < overhead)
+                overhead = delta;
+        }
+    }
+
+    return overhead;
+}
+
+void
+bench_set_work(uint64_t accesses, uint64_t bytes)
+{
+    work_accesses = accesses;
+    work_bytes = bytes;
+}
+
+size_t
+bench_access_slack()
+{
+    return bench_settings.access_offset + bench_settings.access_width;
+}
+
+void
+bench_set_data(const void *data, size_t size)
+{
+    cache_data = data;
+    cache_data_size = size;
+}
+
+static void
+cache_setup()
+{
+    /* bench_settings.line_size is the access stride, which may be
+     * larger than a line, flushes need the hardware line size */
+    const long line_size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+
+    if (line_size > 0)
+        cache_line_size = line_size;
+
+    if (!cache_data) {
+        fprintf(stderr, "This benchmark only supports warm caches.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    switch (bench_settings.cache_state) {
+    case BENCH_CACHE_COLD:
+        cache_flushopt = cpu_have_flushopt();
+        break;
+
+    case BENCH_CACHE_LLC:
+        if (cache_data_size > bench_settings.cache_shared)
+            fprintf(stderr, "Warning: The data set doesn't fit in the "
+                    "shared cache.\n");
+        cache_evict_size = EVICT_FACTOR * bench_settings.cache_private;
+        cache_evict = mem_huge_alloc(cache_evict_size);
+        EXPECT_ERRNO(cache_evict != NULL);
+        mem_touch(cache_evict, cache_evict_size, 1);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void
+bench_prepare()
+{
+    /* Describe the harness settings that change the measurement */
+    if (bench_settings.access_width != 1 || bench_settings.access_store ||
+        bench_settings.access_offset)
+        bench_param("Access", "%s of %zu bytes at offset %zu",
+                    bench_settings.access_store ? "store" : "load",
+                    bench_settings.access_width,
+                    bench_settings.access_offset);
+    /* Retries and the frequency guard only decide which runs are
+     * accepted, they are recorded in the provenance */
+    if (bench_settings.quiet)
+        bench_param("Noise isolation", "quiet,fifo=%i",
+                    bench_settings.fifo_priority);
+    if (bench_settings.cache_state != BENCH_CACHE_WARM)
+        bench_param("Cache state", "%s",
+                    bench_cache_state_names[bench_settings.cache_state]);
+
+    if (bench_settings.cache_state != BENCH_CACHE_WARM)
+        cache_setup();
+}
+
+void
+bench_cache_prepare()
+{
+    const size_t line_size = cache_line_size;
+
+    switch (bench_settings.cache_state) {
+    case BENCH_CACHE_COLD:
+        if (cache_flushopt) {
+            for (size_t i = 0; i < cache_data_size; i += line_size)
+                cpu_flush_line_opt(cache_data + i);
+        } else {
+            for (size_t i = 0; i < cache_data_size; i += line_size)
+                cpu_flush_line(cache_data + i);
+        }
+        cpu_fence();
+        break;
+
+    case BENCH_CACHE_LLC:
+        /* Touch the data set to make sure that it is in the shared
+         * cache, then push it out of the private caches */
+        for (size_t i = 0; i < cache_data_size; i += line_size)
+            (void)*(volatile const char *)(cache_data + i);
+        for (size_t i = 0; i < cache_evict_size; i += line_size)
+            (void)*(volatile const char *)(cache_evict + i);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void
+stop_handler(int sig)
+{
+    bench_stop = 1;
+}
+
+static double
+interval_now()
+{
+    struct timespec ts;
+
+    EXPECT_ERRNO(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void *
+interval_main(void *arg)
+{
+    const long interval_ns = bench_settings.interval * 1000000L;
+    const double start = interval_now();
+    double last_time = start;
+    uint64_t last_progress = 0;
+    struct timespec next;
+
+    EXPECT_ERRNO(clock_gettime(CLOCK_MONOTONIC, &next) == 0);
+    while (!bench_stop) {
+        uint64_t progress;
+        double now, iter_rate;
+
+        next.tv_sec += interval_ns / 1000000000L;
+        next.tv_nsec += interval_ns % 1000000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                               &next, NULL) == EINTR && !bench_stop)
+            ;
+        if (bench_stop)
+            break;
+
+        progress = __atomic_load_n(&bench_progress, __ATOMIC_RELAXED);
+        now = interval_now();
+        iter_rate = (progress - last_progress) / (now - last_time);
+
+        printf("Interval %.3f: %" PRIu64 " iterations, "
+               "%.4g accesses/s, %.1f MB/s\n",
+               now - start, progress - last_progress,
+               iter_rate * work_accesses, iter_rate * work_bytes * 1E-6);
+        fflush(stdout);
+
+        last_progress = progress;
+        last_time = now;
+    }
+
+    return NULL;
+}
+
+void
+bench_interval_start()
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigemptyset(&sa.sa_mask);
+    EXPECT_ERRNO(sigaction(SIGINT, &sa, NULL) == 0);
+    EXPECT_ERRNO(sigaction(SIGTERM, &sa, NULL) == 0);
+
+    bench_stop = 0;
+    __atomic_store_n(&bench_progress, 0, __ATOMIC_RELAXED);
+
+    if (bench_settings.interval > 0) {
+        EXPECT(pthread_create(&interval_thread, NULL,
+                              interval_main, NULL) == 0);
+        interval_running = 1;
+    }
+}
+
+void
+bench_interval_stop()
+{
+    if (interval_running) {
+        EXPECT(pthread_join(interval_thread, NULL) == 0);
+        interval_running = 0;
+    }
+}
+
+static void __attribute__((noinline))
+quiet_prefault_stack()
+{
+    volatile char stack[QUIET_STACK_SIZE];
+
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+static void
+quiet_prepare()
+{
+    timing_t t;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+        fprintf(stderr, "Warning: Failed to lock memory: %s\n",
+                strerror(errno));
+    quiet_prefault_stack();
+
+    /* The vDSO data page isn't locked by mlockall, the first clock
+     * read would fault inside the timed region */
+    timing_init(&t);
+    timing_start(&t);
+    timing_stop(&t);
+
+    if (bench_settings.fifo_priority) {
+        const struct sched_param param = {
+            .sched_priority = bench_settings.fifo_priority,
+        };
+        int err;
+
+        err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err)
+            fprintf(stderr, "Warning: Failed to switch to SCHED_FIFO: %s\n",
+                    strerror(err));
+    }
+
+    quiet_ready = 1;
+}
+
+void
+bench_quiet_start()
+{
+    if (!bench_settings.quiet)
+        return;
+
+    if (!quiet_ready)
+        quiet_prepare();
+
+    EXPECT_ERRNO(getrusage(RUSAGE_THREAD, &quiet_before) == 0);
+}
+
+int
+bench_quiet_stop(unsigned int attempt)
+{
+    struct rusage after;
+
+    if (!bench_settings.quiet)
+        return 0;
+
+    EXPECT_ERRNO(getrusage(RUSAGE_THREAD, &after) == 0);
+    quiet_delta.ru_nvcsw = after.ru_nvcsw - quiet_before.ru_nvcsw;
+    quiet_delta.ru_nivcsw = after.ru_nivcsw - quiet_before.ru_nivcsw;
+    quiet_delta.ru_minflt = after.ru_minflt - quiet_before.ru_minflt;
+    quiet_delta.ru_majflt = after.ru_majflt - quiet_before.ru_majflt;
+    quiet_contaminated =
+        quiet_delta.ru_nvcsw || quiet_delta.ru_nivcsw ||
+        quiet_delta.ru_minflt || quiet_delta.ru_majflt;
+    quiet_attempts = attempt + 1;
+
+    /* Unbounded runs were stopped by the user, don't restart them */
+    if (quiet_contaminated && attempt < bench_settings.retries &&
+        bench_settings.iterations > 0) {
+        fprintf(stderr, "Run contaminated (%ld/%ld context switches, "
+                "%ld/%ld page faults), retrying (%u of %u).\n",
+                quiet_delta.ru_nvcsw, quiet_delta.ru_nivcsw,
+                quiet_delta.ru_minflt, quiet_delta.ru_majflt,
+                attempt + 1, bench_settings.retries);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void
+bench_noise()
+{
+    if (!bench_settings.quiet)
+        return;
+
+    printf("Context switches: %ld voluntary, %ld involuntary\n"
+           "Page faults: %ld minor, %ld major\n"
+           "Attempts: %u\n"
+           "Contaminated: %s\n",
+           quiet_delta.ru_nvcsw, quiet_delta.ru_nivcsw,
+           quiet_delta.ru_minflt, quiet_delta.ru_majflt,
+           quiet_attempts, quiet_contaminated ? "yes" : "no");
+
+    if (quiet_contaminated)
+        fprintf(stderr, "Warning: The run was interrupted by context "
+                "switches or page faults.\n");
+}
+
+void
+bench_param(const char *name, const char *fmt, ...)
+{
+    const size_t len = strlen(bench_config);
+    char value[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(value, sizeof(value), fmt, ap);
+    va_end(ap);
+
+    printf("%s: %s\n", name, value);
+
+    snprintf(bench_config + len, sizeof(bench_config) - len,
+             "%s%s=%s", len ? ";" : "", name, value);
+}
+
+void
+bench_param_placement()
+{
+    char list[256] = "";
+    size_t len = 0;
+
+    for (unsigned int i = 0; i < bench_settings.ncpus && len < sizeof(list);
+         i++) {
+        len += snprintf(list + len, sizeof(list) - len, "%s%i",
+                        i ? "," : "", bench_settings.cpus[i]);
+    }
+
+    bench_param("Placement", "%s",
+                topology_policy_names[bench_settings.placement]);
+    bench_param("CPUs", "%s", list);
+}
+
+static int
+bench_compare(const char *config, const stats_t *iter)
+{
+    stats_t base;
+    double diff, p;
+    const char *verdict;
+    int ret;
+
+    ret = baseline_load(bench_settings.baseline_compare,
+                        program_invocation_short_name, config, &base);
+    if (ret == -1) {
+        fprintf(stderr, "Failed to read baseline '%s': %s\n",
+                bench_settings.baseline_compare, strerror(errno));
+        return 2;
+    } else if (ret == 0 || base.n == 0 || base.mean == 0.0) {
+        fprintf(stderr, "No baseline for this configuration in '%s'.\n",
+                bench_settings.baseline_compare);
+        return 0;
+    }
+
+    diff = (iter->mean - base.mean) / base.mean * 100.0;
+    p = stats_welch_p(iter, &base);
+
+    if (p < BASELINE_ALPHA && diff > bench_settings.threshold) {
+        verdict = "REGRESSION";
+        ret = 1;
+    } else if (p < BASELINE_ALPHA && diff < -bench_settings.threshold) {
+        verdict = "improvement";
+        ret = 0;
+    } else {
+        verdict = "unchanged";
+        ret = 0;
+    }
+
+    printf("Baseline cycles/iteration: %.1f (stddev %.1f, n %" PRIu64 ")\n"
+           "Baseline difference: %+.2f%% (p %.4f)\n"
+           "Baseline verdict: %s\n",
+           base.mean, stats_stddev(&base), base.n,
+           diff, p, verdict);
+
+    return ret;
+}
+
+/**
+ * Report the effective frequency of the last run
+ *
+ * @return 3 if the run is rejected because of frequency drift, 0
+ *         otherwise
+ */
+static int
+bench_frequency()
+{
+    const int cpu = bench_settings.cpu != -1 ? bench_settings.cpu :
+        sched_getcpu();
+    const char *governor = freq_governor(cpu);
+    freq_result_t f;
+    double drift;
+
+    printf("Frequency governor: %s\n", governor);
+    if (freq_result(&f) == -1) {
+        printf("Effective frequency: unavailable\n");
+        return 0;
+    }
 
-	CPU_ZERO(&cpu_set);
-	CPU_SET(bench_settings.cpu, &cpu_set);
-	return sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set);
+    drift = f.effective > 0 ? (f.max - f.min) / f.effective * 100.0 : 0.0;
+    printf("Effective frequency: %.0f MHz (min %.0f, max %.0f, %u samples, "
+           "%s)\n",
+           f.effective * 1E-6, f.min * 1E-6, f.max * 1E-6, f.samples,
+           f.source);
+    if (f.tsc > 0)
+        printf("TSC frequency: %.0f MHz (effective/TSC %.3f)\n",
+               f.tsc * 1E-6, f.effective / f.tsc);
+    printf("Frequency drift: %.2f%%\n", drift);
+
+    if (strcmp(governor, "performance") && strcmp(governor, "unknown"))
+        fprintf(stderr, "Warning: Frequency governor is '%s', results "
+                "may depend on the load.\n", governor);
+
+    if (bench_settings.freq_tolerance > 0 &&
+        drift > bench_settings.freq_tolerance) {
+        fprintf(stderr, "Warning: Effective frequency varied %.2f%% "
+                "(tolerance %.2f%%).\n",
+                drift, bench_settings.freq_tolerance);
+        if (bench_settings.freq_reject) {
+            fprintf(stderr, "Run rejected by the frequency guard.\n");
+            return 3;
+        }
     }
 
     return 0;
 }
 
+int
+bench_report(double wall, uint64_t cycles, const stats_t *iter)
+{
+    const char *config = bench_config[0] ? bench_config : "-";
+    int ret = 0;
+
+    printf("Wall clock time: %.4f\n"
+           "Cycles: %" PRIu64 "\n",
+           wall, cycles);
+
+    if (bench_settings.iterations == 0)
+        printf("Iterations completed: %" PRIu64 "\n", iter->n);
+
+    if (work_accesses && wall > 0)
+        printf("Accesses/s: %.4g\n"
+               "Bandwidth: %.1f MB/s\n",
+               iter->n * work_accesses / wall,
+               iter->n * work_bytes / wall * 1E-6);
+
+    if (iter->n)
+        printf("Cycles/iteration: %.1f (stddev %.1f, min %.0f, max %.0f)\n"
+               "Timer overhead: %" PRIu64 " (subtracted per iteration)\n",
+               iter->mean, stats_stddev(iter), iter->min, iter->max,
+               bench_timer_overhead());
+
+    bench_noise();
+    ret = bench_frequency();
+
+    if (bench_settings.baseline_compare && iter->n && !ret)
+        ret = bench_compare(config, iter);
+
+    if (bench_settings.baseline_save && iter->n && ret != 3) {
+        if (baseline_save(bench_settings.baseline_save,
+                          program_invocation_short_name, config,
+                          provenance_string(), iter)) {
+            fprintf(stderr, "Failed to save baseline '%s': %s\n",
+                    bench_settings.baseline_save, strerror(errno));
+            ret = ret ? ret : 2;
+        }
+    }
+
+    return ret;
+}
+
 
 /*
  * Local Variables:
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include "frequency.h"
+#include "cyclecounter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define MSR_IA32_MPERF 0xE7
+#define MSR_IA32_APERF 0xE8
+
+typedef enum {
+    SOURCE_NONE = 0,
+    SOURCE_PERF_REF,
+    SOURCE_MSR,
+    SOURCE_PERF_TIME,
+} source_t;
+
+static const char *source_names[] = {
+    NULL, "perf cycles/ref-cycles", "APERF/MPERF", "perf cycles/time"
+};
+
+typedef struct {
+    /** Core cycles: perf cycles or APERF */
+    uint64_t core;
+    /** Reference cycles: perf ref-cycles or MPERF */
+    uint64_t ref;
+    /** Time in ns */
+    uint64_t ns;
+    /** TSC, 0 if not available */
+    uint64_t tsc;
+    /** Time the perf counters were enabled in ns */
+    uint64_t enabled;
+    /** Time the perf counters were counting in ns */
+    uint64_t running;
+} reading_t;
+
+static source_t source = SOURCE_NONE;
+static int opened = 0;
+static int perf_fd = -1;
+static int msr_fd = -1;
+
+static reading_t first, last;
+static uint64_t last_sample;
+static freq_result_t result;
+
+static uint64_t
+now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+perf_open_counter(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP |
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void
+open_counters()
+{
+    char path[64];
+    int ref_fd;
+
+    opened = 1;
+
+    perf_fd = perf_open_counter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (perf_fd != -1) {
+        ref_fd = perf_open_counter(PERF_COUNT_HW_REF_CPU_CYCLES, perf_fd);
+        if (ref_fd != -1) {
+            source = SOURCE_PERF_REF;
+            return;
+        }
+    }
+
+    /* The MSRs belong to the CPU the thread is running on, which
+     * requires the benchmark to be pinned. */
+    snprintf(path, sizeof(path), "/dev/cpu/%i/msr", sched_getcpu());
+    msr_fd = open(path, O_RDONLY);
+    if (msr_fd != -1) {
+        uint64_t value;
+
+        if (pread(msr_fd, &value, sizeof(value), MSR_IA32_MPERF) ==
+            sizeof(value)) {
+            /* Don't leave the cycle counter running */
+            if (perf_fd != -1) {
+                close(perf_fd);
+                perf_fd = -1;
+            }
+            source = SOURCE_MSR;
+            return;
+        }
+        close(msr_fd);
+        msr_fd = -1;
+    }
+
+    if (perf_fd != -1)
+        source = SOURCE_PERF_TIME;
+}
+
+static int
+read_counters(reading_t *r)
+{
+    r->ns = now_ns();
+#if defined(__i386__) || defined(__x86_64__)
+    r->tsc = x86_tsc_read();
+#else
+    r->tsc = 0;
+#endif
+
+    switch (source) {
+    case SOURCE_PERF_REF:
+    case SOURCE_PERF_TIME: {
+        /* Number of counters, time enabled, time running and the
+         * counter values */
+        uint64_t values[5];
+        const ssize_t len = source == SOURCE_PERF_REF ?
+            sizeof(values) : 4 * sizeof(uint64_t);
+
+        if (read(perf_fd, values, len) != len)
+            return -1;
+        r->enabled = values[1];
+        r->running = values[2];
+        r->core = values[3];
+        r->ref = source == SOURCE_PERF_REF ? values[4] : 0;
+    } return 0;
+
+    case SOURCE_MSR:
+        r->enabled = r->running = 0;
+        if (pread(msr_fd, &r->core, sizeof(r->core), MSR_IA32_APERF) !=
+            sizeof(r->core) ||
+            pread(msr_fd, &r->ref, sizeof(r->ref), MSR_IA32_MPERF) !=
+            sizeof(r->ref))
+            return -1;
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Compute the TSC frequency between two readings
+ */
+static double
+tsc_hz(const reading_t *a, const reading_t *b)
+{
+    if (!a->tsc || b->ns == a->ns)
+        return 0.0;
+
+    return (b->tsc - a->tsc) * 1E9 / (b->ns - a->ns);
+}
+
+/**
+ * Compute the effective frequency between two readings
+ *
+ * Reference cycles (ref-cycles and MPERF) count at the TSC frequency
+ * while the core is not halted, which makes the core/reference ratio
+ * independent of idle time.
+ */
+static double
+effective_hz(const reading_t *a, const reading_t *b)
+{
+    const double dcore = b->core - a->core;
+
+    /* The counters are scaled estimates if the PMU multiplexed them,
+     * which makes their ratio meaningless */
+    if (b->running - a->running != b->enabled - a->enabled)
+        return 0.0;
+
+    if (source == SOURCE_PERF_TIME || !a->tsc) {
+        if (b->ns == a->ns)
+            return 0.0;
+        return dcore * 1E9 / (b->ns - a->ns);
+    }
+
+    if (b->ref == a->ref)
+        return 0.0;
+
+    return tsc_hz(a, b) * dcore / (b->ref - a->ref);
+}
+
+int
+freq_start()
+{
+    if (!opened)
+        open_counters();
+
+    memset(&result, 0, sizeof(result));
+    if (source == SOURCE_NONE || read_counters(&first) == -1)
+        return -1;
+
+    last = first;
+    last_sample = cycles_get();
+    return 0;
+}
+
+static void
+add_sample(const reading_t *r)
+{
+    const double hz = effective_hz(&last, r);
+
+    if (hz > 0.0) {
+        if (!result.samples || hz < result.min)
+            result.min = hz;
+        if (!result.samples || hz > result.max)
+            result.max = hz;
+        result.samples++;
+    }
+
+    last = *r;
+}
+
+int
+freq_sample(uint64_t now)
+{
+    reading_t r;
+
+    if (source == SOURCE_NONE || now - last_sample < FREQ_SAMPLE_PERIOD)
+        return 0;
+
+    last_sample = now;
+    if (read_counters(&r) == 0)
+        add_sample(&r);
+
+    return 1;
+}
+
+void
+freq_stop()
+{
+    reading_t r;
+
+    if (source == SOURCE_NONE || read_counters(&r) == -1)
+        return;
+
+    add_sample(&r);
+    result.effective = effective_hz(&first, &r);
+    if (result.effective > 0.0)
+        result.source = source_names[source];
+    result.tsc = tsc_hz(&first, &r);
+}
+
+int
+freq_result(freq_result_t *r)
+{
+    if (!result.source || !result.samples)
+        return -1;
+
+    *r = result;
+    return 0;
+}
+
+const char *
+freq_governor(int cpu)
+{
+    static char governor[64];
+    char path[128];
+    FILE *f;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%i/cpufreq/scaling_governor", cpu);
+    f = fopen(path, "r");
+    if (!f || !fgets(governor, sizeof(governor), f))
+        strcpy(governor, "unknown");
+    else
+        governor[strcspn(governor, "\n")] = '\0';
+    if (f)
+        fclose(f);
+
+    return governor;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
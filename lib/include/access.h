@@ -31,6 +31,39 @@
 #ifndef ACCESS_H
 #define ACCESS_H
 
+#include <stddef.h> /* For size_t */
+#include <stdint.h>
+
+/*
+ * Load and store primitives of 1 to 64 bytes. The primitives are
+ * named after the width of the access in bits. None of them require
+ * the address to be aligned, accesses may cross cache line and page
+ * boundaries. The 256 and 512 bit primitives require AVX and AVX-512
+ * respectively, use access_supported before selecting them. Other
+ * architectures than x86 only support accesses of up to 8 bytes.
+ */
+
+/**
+ * Call X(arg, name, bytes) for every access primitive
+ *
+ * Loads come before stores and each group is ordered by width, which
+ * makes access_index a valid index into tables built with this
+ * macro.
+ */
+#define ACCESS_PRIMITIVES(X, arg)                                       \
+    X(arg, rd8, 1) X(arg, rd16, 2) X(arg, rd32, 4) X(arg, rd64, 8)      \
+    X(arg, rd128, 16) X(arg, rd256, 32) X(arg, rd512, 64)               \
+    X(arg, wr8, 1) X(arg, wr16, 2) X(arg, wr32, 4) X(arg, wr64, 8)      \
+    X(arg, wr128, 16) X(arg, wr256, 32) X(arg, wr512, 64)
+
+/** Number of primitives in ACCESS_PRIMITIVES */
+#define ACCESS_COUNT 14
+
+/** Widest access in bytes */
+#define ACCESS_MAX_WIDTH 64
+
+#if defined(__i386__) || defined(__x86_64__)
+
 static inline char __attribute__((always_inline))
 access_rd8(const char *d)
 {
@@ -41,6 +74,221 @@ access_rd8(const char *d)
     return c;
 }
 
+static inline uint16_t __attribute__((always_inline))
+access_rd16(const char *d)
+{
+    uint16_t v;
+    asm volatile ("mov %1, %0"
+                  : "=r"(v)
+                  : "m"(*(const uint16_t *)d));
+    return v;
+}
+
+static inline uint32_t __attribute__((always_inline))
+access_rd32(const char *d)
+{
+    uint32_t v;
+    asm volatile ("mov %1, %0"
+                  : "=r"(v)
+                  : "m"(*(const uint32_t *)d));
+    return v;
+}
+
+static inline uint64_t __attribute__((always_inline))
+access_rd64(const char *d)
+{
+    uint64_t v;
+    asm volatile ("mov %1, %0"
+                  : "=r"(v)
+                  : "m"(*(const uint64_t *)d));
+    return v;
+}
+
+static inline void __attribute__((always_inline))
+access_rd128(const char *d)
+{
+    asm volatile ("movdqu %0, %%xmm0"
+                  :: "m"(*(const char (*)[16])d) : "xmm0");
+}
+
+static inline void __attribute__((always_inline))
+access_rd256(const char *d)
+{
+    asm volatile ("vmovdqu %0, %%ymm0"
+                  :: "m"(*(const char (*)[32])d) : "xmm0");
+}
+
+static inline void __attribute__((always_inline))
+access_rd512(const char *d)
+{
+    asm volatile ("vmovdqu64 %0, %%zmm0"
+                  :: "m"(*(const char (*)[64])d) : "xmm0");
+}
+
+static inline void __attribute__((always_inline))
+access_wr8(char *d)
+{
+    asm volatile ("movb %1, %0"
+                  : "=m"(*d)
+                  : "r"((char)0));
+}
+
+static inline void __attribute__((always_inline))
+access_wr16(char *d)
+{
+    asm volatile ("movw %1, %0"
+                  : "=m"(*(uint16_t *)d)
+                  : "r"((uint16_t)0));
+}
+
+static inline void __attribute__((always_inline))
+access_wr32(char *d)
+{
+    asm volatile ("movl %1, %0"
+                  : "=m"(*(uint32_t *)d)
+                  : "r"((uint32_t)0));
+}
+
+static inline void __attribute__((always_inline))
+access_wr64(char *d)
+{
+    asm volatile ("movq %1, %0"
+                  : "=m"(*(uint64_t *)d)
+                  : "r"((uint64_t)0));
+}
+
+static inline void __attribute__((always_inline))
+access_wr128(char *d)
+{
+    asm volatile ("movdqu %%xmm0, %0"
+                  : "=m"(*(char (*)[16])d));
+}
+
+static inline void __attribute__((always_inline))
+access_wr256(char *d)
+{
+    asm volatile ("vmovdqu %%ymm0, %0"
+                  : "=m"(*(char (*)[32])d));
+}
+
+static inline void __attribute__((always_inline))
+access_wr512(char *d)
+{
+    asm volatile ("vmovdqu64 %%zmm0, %0"
+                  : "=m"(*(char (*)[64])d));
+}
+
+/**
+ * Leave the AVX state after a sequence of accesses
+ *
+ * Wide accesses leave the upper halves of the vector registers dirty,
+ * which slows down the SSE code that follows on some CPUs. Call this
+ * after a loop of accesses of the given width.
+ *
+ * @param width Access width in bytes
+ */
+static inline void __attribute__((always_inline))
+access_finish(size_t width)
+{
+    if (width >= 32)
+        asm volatile ("vzeroupper");
+}
+
+#else
+
+/* Generic accesses copy through a local variable that is kept alive
+ * by an empty asm statement, the compiler picks the load or store
+ * instruction. */
+#define ACCESS_GENERIC(bits, type)                                      \
+    static inline type __attribute__((always_inline))                   \
+    access_rd ## bits(const char *d)                                    \
+    {                                                                   \
+        type v;                                                         \
+        __builtin_memcpy(&v, d, sizeof(v));                             \
+        asm volatile ("" :: "r"(v) : "memory");                         \
+        return v;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline void __attribute__((always_inline))                   \
+    access_wr ## bits(char *d)                                          \
+    {                                                                   \
+        const type v = 0;                                               \
+        __builtin_memcpy(d, &v, sizeof(v));                             \
+        asm volatile ("" ::: "memory");                                 \
+    }
+
+/* Wider accesses aren't supported, see access_supported. They are
+ * only defined to allow tables built with ACCESS_PRIMITIVES. */
+#define ACCESS_UNSUPPORTED(bits)                                        \
+    static inline void                                                  \
+    access_rd ## bits(const char *d)                                    \
+    {                                                                   \
+        (void)d;                                                        \
+    }                                                                   \
+                                                                        \
+    static inline void                                                  \
+    access_wr ## bits(char *d)                                          \
+    {                                                                   \
+        (void)d;                                                        \
+    }
+
+ACCESS_GENERIC(8, char)
+ACCESS_GENERIC(16, uint16_t)
+ACCESS_GENERIC(32, uint32_t)
+ACCESS_GENERIC(64, uint64_t)
+ACCESS_UNSUPPORTED(128)
+ACCESS_UNSUPPORTED(256)
+ACCESS_UNSUPPORTED(512)
+
+static inline void __attribute__((always_inline))
+access_finish(size_t width)
+{
+    (void)width;
+}
+
+#endif
+
+/**
+ * Index of a primitive in tables built with ACCESS_PRIMITIVES
+ *
+ * @param width Access width in bytes, a power of two
+ * @param store Non-zero for stores
+ * @return Index of the primitive
+ */
+static inline unsigned int
+access_index(size_t width, int store)
+{
+    unsigned int index = 0;
+
+    while ((1UL << index) < width)
+        index++;
+
+    return index + (store ? ACCESS_COUNT / 2 : 0);
+}
+
+/**
+ * Check if the CPU supports accesses of a given width
+ *
+ * @param width Access width in bytes
+ * @return Non-zero if width is a supported power of two.
+ */
+static inline int
+access_supported(size_t width)
+{
+    if (!width || width > ACCESS_MAX_WIDTH || (width & (width - 1)))
+        return 0;
+#if defined(__i386__) || defined(__x86_64__)
+    if (width == 32)
+        return __builtin_cpu_supports("avx");
+    if (width == 64)
+        return __builtin_cpu_supports("avx512f");
+
+    return 1;
+#else
+    return width <= 8;
+#endif
+}
+
 #endif
 
 /*
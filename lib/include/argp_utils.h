@@ -66,4 +66,11 @@ uint8_t argp_parse_uint8(struct argp_state *state,
 size_t argp_parse_size(struct argp_state *state,
 		       const char *name, const char *arg);
 
+double argp_parse_double(struct argp_state *state,
+			 const char *name, const char *arg);
+
+unsigned int argp_parse_cpu_list(struct argp_state *state,
+				 const char *name, const char *arg,
+				 int **cpus);
+
 #endif
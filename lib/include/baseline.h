@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include "stats.h"
+
+/**
+ * Append a result record to a baseline file
+ *
+ * A baseline file is a plain text file with one record per line. A
+ * record is identified by the name of the program that produced it
+ * and a string describing the benchmark's configuration. Records
+ * from several benchmarks and configurations can be stored in the
+ * same file.
+ *
+ * @param file Baseline file, created if it does not exist
+ * @param program Name of the benchmark
+ * @param config Benchmark configuration
+ * @param provenance Description of the host and build, stored as
+ *                   additional information and ignored when loading
+ *                   records, NULL to omit
+ * @param s Per-iteration statistics
+ * @return 0 on success, -1 on error. Sets errno on error.
+ */
+int baseline_save(const char *file, const char *program, const char *config,
+                  const char *provenance, const stats_t *s);
+
+/**
+ * Load a result record from a baseline file
+ *
+ * If there are several records matching the program and
+ * configuration, the most recent one (i.e. the last one in the file)
+ * is used.
+ *
+ * @param file Baseline file
+ * @param program Name of the benchmark
+ * @param config Benchmark configuration
+ * @param s Statistics stored in the record
+ * @return 1 if a matching record was found, 0 if no record was
+ *         found, -1 on error. Sets errno on error.
+ */
+int baseline_load(const char *file, const char *program, const char *config,
+                  stats_t *s);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -34,22 +34,77 @@
 #include <stddef.h> /* For size_t */
 #include <argp.h>
 
+#include "topology.h"
+
+/** State of the caches at the start of each iteration */
+typedef enum {
+    /** Run iterations back-to-back */
+    BENCH_CACHE_WARM = 0,
+    /** Flush the data set from all cache levels */
+    BENCH_CACHE_COLD,
+    /** Evict the data set from the private caches */
+    BENCH_CACHE_LLC,
+} bench_cache_state_t;
+
+/** Names of the cache states, NULL terminated */
+extern const char *bench_cache_state_names[];
+
 typedef struct {
     /** Pin to CPU, -1 to disable pinning */
     int cpu;
+    /** CPUs to run threads on in multi-threaded benchmarks */
+    int *cpus;
+    /** Number of entries in cpus */
+    unsigned int ncpus;
+    /** Policy used to order cpus */
+    topology_policy_t placement;
     /** Number of iterations to run */
     unsigned int iterations;
+    /** Cache state at the start of each iteration */
+    bench_cache_state_t cache_state;
+    /** Reporting interval in ms for unbounded runs, 0 to disable */
+    unsigned int interval;
     /** Size of private cache */
     size_t cache_private;
     /** Size of shared cache */
     size_t cache_shared;
     /** Line size */
     size_t line_size;
+    /** Width of memory accesses in bytes */
+    size_t access_width;
+    /** Use stores instead of loads */
+    int access_store;
+    /** Offset of accesses from the start of a line */
+    size_t access_offset;
+    /** Baseline file to store results in, NULL to disable */
+    const char *baseline_save;
+    /** Baseline file to compare results against, NULL to disable */
+    const char *baseline_compare;
+    /** Relative difference (in percent) that is reported as a change */
+    double threshold;
+    /** Frequency drift (in percent) that is reported, 0 to disable */
+    double freq_tolerance;
+    /** Fail runs whose frequency drifted more than the tolerance */
+    int freq_reject;
+    /** Lock memory and check timed regions for system noise */
+    int quiet;
+    /** SCHED_FIFO priority used in quiet mode, 0 to disable */
+    int fifo_priority;
+    /** Number of times a contaminated run is retried in quiet mode */
+    unsigned int retries;
 } bench_settings_t;
 
 extern bench_settings_t bench_settings;
 extern struct argp bench_argp;
 
+/**
+ * Set by benchmarks that run through RUN_BENCH before parsing their
+ * options. Options that only affect RUN_BENCH, like baselines, the
+ * frequency guard, noise isolation, cache state and access options,
+ * are rejected by other benchmarks.
+ */
+extern int bench_argp_run_bench;
+
 #endif
 
 /*
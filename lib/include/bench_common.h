@@ -33,39 +33,85 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <signal.h>
 
 #include "timing.h"
 #include "cyclecounter.h"
 #include "bench_argp.h"
+#include "stats.h"
+#include "frequency.h"
+
+/** Set by SIGINT/SIGTERM to end an unbounded run */
+extern volatile sig_atomic_t bench_stop;
+
+/** Number of iterations completed by the running benchmark */
+extern uint64_t bench_progress;
 
 #define RUN_BENCH(name, func)						\
-    static void __attribute__((noinline))				\
+    static int __attribute__((noinline))				\
     name()								\
     {									\
         timing_t t;							\
+	stats_t iter;							\
 	uint64_t cycles_start;						\
+	uint64_t cycles_last;						\
 	uint64_t cycles_stop;						\
+	uint64_t cycles_excluded;					\
+	const uint64_t overhead = bench_timer_overhead();		\
+	unsigned int attempt = 0;					\
 									\
+	bench_prepare();						\
+    retry:								\
+	stats_init(&iter);						\
+	if (bench_settings.iterations == 0)				\
+	    bench_interval_start();					\
 	timing_init(&t);						\
+	bench_quiet_start();						\
 	timing_start(&t);						\
+	freq_start();							\
 	cycles_start = cycles_get();					\
-	if (bench_settings.iterations > 0) {				\
-	    for (unsigned int i = 0;					\
-		 i < bench_settings.iterations;				\
-		 i++) {							\
-		func();							\
-	    }								\
-	} else {							\
-	    while (1) {							\
-		func();                                                 \
+	cycles_last = cycles_start;					\
+	cycles_excluded = 0;						\
+	for (uint64_t i = 0;						\
+	     bench_settings.iterations > 0 ?				\
+		 i < bench_settings.iterations : !bench_stop;		\
+	     ) {							\
+	    uint64_t cycles_now;					\
+	    uint64_t cycles_iter;					\
+									\
+	    if (bench_settings.cache_state != BENCH_CACHE_WARM) {	\
+		bench_cache_prepare();					\
+		cycles_now = cycles_get();				\
+		cycles_excluded += cycles_now - cycles_last;		\
+		cycles_last = cycles_now;				\
 	    }								\
+	    func();							\
+	    cycles_now = cycles_get();					\
+	    cycles_iter = cycles_now - cycles_last;			\
+	    stats_add(&iter, cycles_iter > overhead ?			\
+		      cycles_iter - overhead : 0);			\
+	    /* Keep frequency samples out of the next iteration */	\
+	    if (freq_sample(cycles_now))				\
+		cycles_now = cycles_get();				\
+	    cycles_last = cycles_now;					\
+	    __atomic_store_n(&bench_progress, ++i, __ATOMIC_RELAXED);	\
 	}								\
 	cycles_stop = cycles_get();					\
 	timing_stop(&t);						\
+	freq_stop();							\
+	if (bench_settings.iterations == 0)				\
+	    bench_interval_stop();					\
+	if (bench_quiet_stop(attempt++))				\
+	    goto retry;							\
 									\
-	printf("Wall clock time: %.4f\n"				\
-	       "Cycles: %" PRIu64 "\n",					\
-	       t.acc, cycles_stop - cycles_start);			\
+	/* Cache preparation is excluded from the totals, scale the	\
+	 * wall clock time by the fraction of cycles that remain */	\
+	if (cycles_excluded && cycles_stop > cycles_start)		\
+	    t.acc *= (double)(cycles_stop - cycles_start - cycles_excluded) \
+		/ (cycles_stop - cycles_start);				\
+	return bench_report(t.acc,					\
+			    cycles_stop - cycles_start - cycles_excluded, \
+			    &iter);					\
     }
 
 /**
@@ -75,6 +121,160 @@
  */
 int bench_pin_cpu();
 
+/**
+ * Pin the calling thread to a CPU
+ *
+ * @param cpu CPU to run on
+ * @return 0 on success, -1 on error. Sets errno on error.
+ */
+int bench_pin_thread(int cpu);
+
+/**
+ * Cost of reading the cycle counter
+ *
+ * The overhead is the smallest difference between two back-to-back
+ * cycles_get calls. It is measured on the first call and subtracted
+ * from every per-iteration sample in RUN_BENCH.
+ *
+ * @return Overhead in cycle counter ticks
+ */
+uint64_t bench_timer_overhead();
+
+/**
+ * Describe the work done in one benchmark iteration
+ *
+ * The amount of work per iteration is used to convert iteration
+ * counts into access rates and bandwidth in interval reports and
+ * result summaries.
+ *
+ * @param accesses Number of memory accesses per iteration
+ * @param bytes Number of bytes (cache lines times line size) touched
+ *              per iteration
+ */
+void bench_set_work(uint64_t accesses, uint64_t bytes);
+
+/**
+ * Number of bytes accesses extend past the start of their line
+ *
+ * Misaligned and wide accesses to the last line of a data set touch
+ * memory beyond its end. Benchmarks using the access settings should
+ * allocate this many bytes in addition to their data set.
+ *
+ * @return Size of the extra memory in bytes
+ */
+size_t bench_access_slack();
+
+/**
+ * Register the benchmark's data set
+ *
+ * The data set is flushed or evicted from the caches before each
+ * iteration when the benchmark runs with a cold or LLC-only cache
+ * state. Benchmarks that don't register a data set only support
+ * warm caches.
+ *
+ * @param data Start of the data set
+ * @param size Size of the data set in bytes
+ */
+void bench_set_data(const void *data, size_t size);
+
+/**
+ * Prepare for a benchmark run
+ *
+ * Called by RUN_BENCH once before the run. Describes the harness
+ * settings that change the measurement as benchmark parameters and
+ * allocates the buffers needed to bring the caches into the
+ * requested state, which keeps the allocations out of the timed
+ * region.
+ */
+void bench_prepare();
+
+/**
+ * Bring the caches into the state requested in the benchmark settings
+ *
+ * Called by RUN_BENCH before each iteration when the cache state
+ * isn't warm. The time spent here is excluded from the results.
+ */
+void bench_cache_prepare();
+
+/**
+ * Start periodic reporting for an unbounded run
+ *
+ * Install SIGINT and SIGTERM handlers that set bench_stop and start
+ * a reporter thread that samples bench_progress every
+ * bench_settings.interval milliseconds. Sampling a counter from a
+ * separate thread keeps the benchmark loop free of timer calls and
+ * system calls.
+ */
+void bench_interval_start();
+
+/**
+ * Stop the reporter thread started by bench_interval_start
+ */
+void bench_interval_stop();
+
+/**
+ * Prepare for a timed region
+ *
+ * Does nothing unless bench_settings.quiet is set. The first call
+ * locks all current and future memory (which also pre-faults the
+ * benchmark's data set and sample buffers), pre-faults the stack and
+ * optionally switches the calling thread to SCHED_FIFO. Every call
+ * records the thread's context switch and page fault counters.
+ */
+void bench_quiet_start();
+
+/**
+ * Check a timed region for system noise
+ *
+ * Compare the thread's context switch and page fault counters
+ * against the values recorded by bench_quiet_start and flag the run
+ * as contaminated if any of them changed.
+ *
+ * @param attempt Number of previous attempts of this run
+ * @return 1 if the run was contaminated and should be retried, 0
+ *         otherwise.
+ */
+int bench_quiet_stop(unsigned int attempt);
+
+/**
+ * Describe a benchmark parameter
+ *
+ * Print the value of a benchmark parameter and add it to the
+ * configuration that identifies this benchmark's records in baseline
+ * files. Parameters should be described before the benchmark is run.
+ *
+ * @param name Human readable parameter name
+ * @param fmt printf style format of the parameter value
+ */
+void bench_param(const char *name, const char *fmt, ...)
+    __attribute__((format (printf, 2, 3)));
+
+/**
+ * Describe the thread placement
+ *
+ * Describe the placement policy and the resulting CPU list as
+ * benchmark parameters. Multi-threaded benchmarks should call this
+ * together with bench_param.
+ */
+void bench_param_placement();
+
+/**
+ * Report the results of a benchmark run
+ *
+ * Print the results of a run, including the effective frequency
+ * and system noise during the run, and, depending on the benchmark
+ * settings, store
+ * them in or compare them against a baseline file. Runs rejected by
+ * the frequency guard are neither compared nor stored.
+ *
+ * @param wall Wall clock time in seconds
+ * @param cycles Number of cycles the run took
+ * @param iter Per-iteration cycle statistics
+ * @return Exit status for the benchmark, non-zero if a regression
+ *         was detected or the run was rejected.
+ */
+int bench_report(double wall, uint64_t cycles, const stats_t *iter);
+
 #endif
 
 /*
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FREQUENCY_H
+#define FREQUENCY_H
+
+#include <stdint.h>
+
+/** Cycle counter ticks between frequency samples */
+#define FREQ_SAMPLE_PERIOD 10000000ULL
+
+typedef struct {
+    /** Name of the counters used, NULL if none were available */
+    const char *source;
+    /** Effective core frequency over the whole run in Hz */
+    double effective;
+    /** Lowest and highest effective frequency of any sample */
+    double min;
+    double max;
+    /** TSC frequency in Hz, 0 if unknown */
+    double tsc;
+    /** Number of samples */
+    unsigned int samples;
+} freq_result_t;
+
+/**
+ * Start measuring the effective frequency of the calling thread
+ *
+ * Uses the ratio of the perf cycles and ref-cycles counters, the
+ * APERF and MPERF MSRs (through /dev/cpu/N/msr) or, as a last resort,
+ * perf cycles divided by wall clock time. The counters are opened on
+ * the first call.
+ *
+ * @return 0 on success, -1 if no counters are available
+ */
+int freq_start();
+
+/**
+ * Take an intermediate sample
+ *
+ * Cheap unless FREQ_SAMPLE_PERIOD ticks have passed since the last
+ * sample.
+ *
+ * @param now Current cycle counter value (cycles_get)
+ * @return 1 if a sample was taken, 0 otherwise
+ */
+int freq_sample(uint64_t now);
+
+/**
+ * Stop measuring and take a final sample
+ */
+void freq_stop();
+
+/**
+ * Get the result of the last measurement
+ *
+ * @return 0 on success, -1 if there is no result
+ */
+int freq_result(freq_result_t *result);
+
+/**
+ * Read the frequency governor of a CPU
+ *
+ * @return Governor name, or "unknown"
+ */
+const char *freq_governor(int cpu);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -50,6 +50,51 @@ void *mem_huge_alloc(size_t size);
  */
 void mem_huge_free(void *addr, size_t size);
 
+typedef enum {
+    /** Base pages, transparent huge pages disabled */
+    MEM_PAGE_SMALL = 0,
+    /** Transparent huge pages (madvise(MADV_HUGEPAGE)) */
+    MEM_PAGE_THP,
+    /** hugetlbfs pages, like mem_huge_alloc */
+    MEM_PAGE_HUGETLB,
+} mem_page_t;
+
+/** Populate the page tables when allocating */
+#define MEM_POPULATE 0x1
+
+/**
+ * Allocate anonymous memory backed by a specific page type
+ *
+ * Memory must be free'd with mem_free using the same size and type.
+ * Populating transparent huge pages requires MADV_POPULATE_WRITE
+ * (Linux 5.14), the allocation fails with errno set if the kernel
+ * doesn't support it.
+ *
+ * @param size Size of allocation in bytes
+ * @param type Type of pages backing the allocation
+ * @param flags MEM_POPULATE or 0
+ * @return NULL on error
+ */
+void *mem_alloc(size_t size, mem_page_t type, int flags);
+
+/**
+ * Free memory allocated with mem_alloc
+ */
+void mem_free(void *addr, size_t size, mem_page_t type);
+
+/**
+ * Touch memory to fault it in
+ *
+ * Write to every stride bytes of the buffer. This is the first-touch
+ * loop used by the benchmarks to make sure that their data sets are
+ * backed by memory before they are measured.
+ *
+ * @param addr Start of the buffer
+ * @param size Size of the buffer in bytes
+ * @param stride Distance between writes, 1 to write every byte
+ */
+void mem_touch(void *addr, size_t size, size_t stride);
+
 #endif
 
 /*
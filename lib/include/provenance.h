@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PROVENANCE_H
+#define PROVENANCE_H
+
+#include <stdio.h>
+
+/**
+ * Collect information about the host and the build
+ *
+ * Gathers the CPU model and microcode revision, kernel version,
+ * frequency governor and turbo state, transparent huge page settings
+ * and huge page pools, NUMA layout, SMT state, compiler, compiler
+ * flags and git revision of the build, and the common benchmark
+ * settings. Subsequent calls have no effect.
+ */
+void provenance_collect();
+
+/**
+ * Add an entry to the provenance information
+ *
+ * @param name Human readable name
+ * @param fmt printf style format of the value
+ */
+void provenance_add(const char *name, const char *fmt, ...)
+    __attribute__((format (printf, 2, 3)));
+
+/**
+ * Print the provenance information, one "name: value" line per entry
+ */
+void provenance_print(FILE *f);
+
+/**
+ * Get the provenance information as a single line
+ *
+ * The entries are formatted as name=value and separated by
+ * semicolons. Tabs and newlines are never part of the string, which
+ * makes it suitable for baseline records.
+ */
+const char *provenance_string();
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
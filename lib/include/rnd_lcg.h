@@ -31,6 +31,7 @@
 #ifndef RND_LCG_H
 #define RND_LCG_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define RND_LCG64_A (6364136223846793005ULL)
@@ -51,6 +52,180 @@ rnd_lcg32(uint64_t prev)
     return RND_LCG32_A * prev + RND_LCG32_C;
 }
 
+/**
+ * Reduce a random number to the range [0, range)
+ *
+ * Uses the high half of a 64x64-bit multiplication (Lemire's
+ * multiply-shift reduction) instead of a division. The result depends
+ * on the high bits of x, which makes it suitable for LCGs whose low
+ * bits are poorly distributed.
+ */
+static inline uint64_t
+rnd_range64(uint64_t x, uint64_t range)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * range) >> 64);
+#else
+    const uint64_t x_lo = (uint32_t)x, x_hi = x >> 32;
+    const uint64_t r_lo = (uint32_t)range, r_hi = range >> 32;
+    const uint64_t lo_lo = x_lo * r_lo;
+    const uint64_t hi_lo = x_hi * r_lo;
+    const uint64_t lo_hi = x_lo * r_hi;
+    const uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+
+    return x_hi * r_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+/**
+ * SplitMix64, used to expand a seed into generator state
+ */
+static inline uint64_t
+rnd_splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Marsaglia's xorshift64, prev must not be 0
+ */
+static inline uint64_t
+rnd_xorshift64(uint64_t prev)
+{
+    prev ^= prev << 13;
+    prev ^= prev >> 7;
+    prev ^= prev << 17;
+    return prev;
+}
+
+typedef struct {
+    uint64_t s[4];
+} rnd_xoshiro256_t;
+
+static inline void
+rnd_xoshiro256_seed(rnd_xoshiro256_t *state, uint64_t seed)
+{
+    for (int i = 0; i < 4; i++)
+        state->s[i] = rnd_splitmix64(&seed);
+}
+
+static inline uint64_t
+rnd_rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * xoshiro256** by Blackman and Vigna
+ */
+static inline uint64_t
+rnd_xoshiro256(rnd_xoshiro256_t *state)
+{
+    uint64_t *s = state->s;
+    const uint64_t result = rnd_rotl64(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rnd_rotl64(s[3], 45);
+
+    return result;
+}
+
+#define RND_PCG32_MULT (6364136223846793005ULL)
+#define RND_PCG32_INC (1442695040888963407ULL)
+
+/**
+ * PCG32 (XSH-RR) by O'Neill
+ *
+ * Uses the same 64-bit LCG as rnd_lcg64 as the underlying state
+ * transition, but outputs a permutation of the high bits instead of
+ * the raw state.
+ */
+static inline uint32_t
+rnd_pcg32(uint64_t *state)
+{
+    const uint64_t old = *state;
+    const uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+    const uint32_t rot = old >> 59;
+
+    *state = old * RND_PCG32_MULT + RND_PCG32_INC;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/**
+ * 64 random bits from two PCG32 outputs
+ */
+static inline uint64_t
+rnd_pcg64(uint64_t *state)
+{
+    const uint64_t hi = rnd_pcg32(state);
+
+    return (hi << 32) | rnd_pcg32(state);
+}
+
+/** Number of independent xorshift64 generators in a batch */
+#define RND_BATCH_LANES 8
+
+typedef struct {
+    uint64_t s[RND_BATCH_LANES];
+} rnd_batch_t;
+
+static inline void
+rnd_batch_seed(rnd_batch_t *batch, uint64_t seed)
+{
+    for (int i = 0; i < RND_BATCH_LANES; i++) {
+        do {
+            batch->s[i] = rnd_splitmix64(&seed);
+        } while (!batch->s[i]);
+    }
+}
+
+/**
+ * Fill a buffer with random numbers in [0, range)
+ *
+ * The buffer is filled from several independent xorshift64
+ * generators that are stepped in lockstep. The lanes have no
+ * dependencies between each other, which lets the compiler vectorize
+ * the generator. Intended to generate addresses ahead of a timed
+ * loop.
+ */
+static inline void
+rnd_batch_fill(rnd_batch_t *batch, uint64_t *out, size_t n, uint64_t range)
+{
+    uint64_t s[RND_BATCH_LANES];
+    size_t i;
+
+    for (int l = 0; l < RND_BATCH_LANES; l++)
+        s[l] = batch->s[l];
+
+    for (i = 0; i + RND_BATCH_LANES <= n; i += RND_BATCH_LANES) {
+        for (int l = 0; l < RND_BATCH_LANES; l++) {
+            s[l] ^= s[l] << 13;
+            s[l] ^= s[l] >> 7;
+            s[l] ^= s[l] << 17;
+            out[i + l] = s[l];
+        }
+    }
+    for (int l = 0; i < n; i++, l++) {
+        s[l] = rnd_xorshift64(s[l]);
+        out[i] = s[l];
+    }
+
+    for (i = 0; i < n; i++)
+        out[i] = rnd_range64(out[i], range);
+
+    for (int l = 0; l < RND_BATCH_LANES; l++)
+        batch->s[l] = s[l];
+}
+
 #endif
 
 /*
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Running sample statistics
+ *
+ * Samples are accumulated using Welford's online algorithm, which
+ * means that no sample buffer is needed and that the mean and
+ * variance are numerically stable even for long runs.
+ */
+typedef struct {
+    /** Number of samples */
+    uint64_t n;
+    /** Sample mean */
+    double mean;
+    /** Sum of squared differences from the mean */
+    double m2;
+    /** Smallest sample */
+    double min;
+    /** Largest sample */
+    double max;
+} stats_t;
+
+void stats_init(stats_t *s);
+void stats_add(stats_t *s, double x);
+
+/**
+ * Sample variance (Bessel corrected), 0 if fewer than two samples
+ */
+double stats_variance(const stats_t *s);
+double stats_stddev(const stats_t *s);
+
+/**
+ * Welch's unequal variances t-test
+ *
+ * Test the hypothesis that the populations behind a and b have the
+ * same mean.
+ *
+ * @return Two-sided p-value, 1.0 if the test is undefined (e.g. too
+ *         few samples).
+ */
+double stats_welch_p(const stats_t *a, const stats_t *b);
+
+/**
+ * Sort an array of samples in ascending order
+ */
+void stats_sort_u64(uint64_t *v, size_t n);
+
+/**
+ * Percentile of a sorted array of samples
+ *
+ * @param v Samples sorted in ascending order
+ * @param n Number of samples, must be at least 1
+ * @param p Percentile, 0-100
+ * @return The sample at the nearest rank of p
+ */
+uint64_t stats_percentile_u64(const uint64_t *v, size_t n, double p);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
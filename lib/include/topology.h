@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+/**
+ * Parse a CPU list
+ *
+ * Parse a comma-separated list of CPUs and CPU ranges, e.g.,
+ * "0,2,4-7", as used by the kernel in sysfs and by the --cpus
+ * option. Trailing white space is ignored. The list is allocated with
+ * malloc and must be free'd by the caller.
+ *
+ * @param str List to parse
+ * @param cpus Pointer to store the parsed list in
+ * @return Number of CPUs in the list, -1 on error (errno is set)
+ */
+int topology_parse_cpu_list(const char *str, int **cpus);
+
+/**
+ * Get the hardware threads sharing a core with a CPU
+ *
+ * Read the thread siblings of a CPU from sysfs. The list includes the
+ * CPU itself and must be free'd by the caller.
+ *
+ * @param cpu CPU to query
+ * @param siblings Pointer to store the list of siblings in
+ * @return Number of siblings, -1 on error (errno is set)
+ */
+int topology_siblings(int cpu, int **siblings);
+
+typedef enum {
+    /** Use the CPUs in the order they were listed */
+    TOPOLOGY_LIST = 0,
+    /** Fill the siblings of a core, then the cores of a package */
+    TOPOLOGY_COMPACT,
+    /** Round-robin across packages and cores, siblings last */
+    TOPOLOGY_SCATTER,
+    /** One thread per physical core, in compact order */
+    TOPOLOGY_CORE,
+} topology_policy_t;
+
+/** Names of the placement policies, terminated by NULL */
+extern const char *topology_policy_names[];
+
+/**
+ * Order a list of CPUs according to a placement policy
+ *
+ * Reorder the CPUs in place using the core and package IDs from
+ * sysfs. CPUs without topology information are treated as separate
+ * cores in package 0. The TOPOLOGY_CORE policy drops all but the
+ * first CPU of every core, the remaining policies keep all CPUs.
+ *
+ * @param policy Placement policy
+ * @param cpus List of CPUs to reorder
+ * @param ncpus Number of entries in cpus
+ * @return Number of CPUs in the resulting list, -1 on error
+ */
+int topology_place(topology_policy_t policy, int *cpus, unsigned int ncpus);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
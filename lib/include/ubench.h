@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UBENCH_H
+#define UBENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory.h"
+
+/*
+ * Embeddable probe API
+ *
+ * A context holds all state of a probe, contexts can be used from
+ * different threads concurrently as long as each context is only used
+ * by one thread at a time. A typical probe creates a context,
+ * configures it, allocates the data set, runs a number of iterations
+ * and fetches the results:
+ *
+ *   ubench_t *ctx = ubench_create();
+ *   ubench_set_pattern(ctx, UBENCH_PATTERN_CHASE);
+ *   ubench_set_size(ctx, 64 * 1024 * 1024);
+ *   if (ubench_alloc(ctx) == 0 && ubench_run(ctx, 10) == 0)
+ *       ubench_result(ctx, &result);
+ *   ubench_destroy(ctx);
+ *
+ * Functions returning int return 0 on success and -1 on error with
+ * errno set.
+ */
+
+typedef struct ubench ubench_t;
+
+typedef enum {
+    /** Read one byte from every line in address order (bandwidth) */
+    UBENCH_PATTERN_BLOCK = 0,
+    /** Read one byte from random lines (throughput) */
+    UBENCH_PATTERN_RANDOM,
+    /** Chase pointers through the lines in random order (latency) */
+    UBENCH_PATTERN_CHASE,
+} ubench_pattern_t;
+
+typedef struct {
+    /** Number of iterations run */
+    uint64_t iterations;
+    /** Accesses per iteration */
+    uint64_t accesses;
+    /** Wall clock time of all iterations in seconds */
+    double wall;
+    /** Cycles per iteration */
+    double cycles_mean;
+    double cycles_stddev;
+    double cycles_min;
+    double cycles_max;
+    /** Average time per access in nanoseconds */
+    double ns_per_access;
+    /** Bytes of lines accessed per second */
+    double bytes_per_second;
+} ubench_result_t;
+
+/**
+ * Create a context with default settings
+ *
+ * The defaults are the block pattern, a 16 MiB data set of base pages,
+ * 64 byte lines and no pinning.
+ *
+ * @return NULL on error
+ */
+ubench_t *ubench_create();
+
+/**
+ * Free a context and its data set
+ */
+void ubench_destroy(ubench_t *ctx);
+
+int ubench_set_pattern(ubench_t *ctx, ubench_pattern_t pattern);
+int ubench_set_size(ubench_t *ctx, size_t size);
+int ubench_set_line_size(ubench_t *ctx, size_t line_size);
+int ubench_set_page_type(ubench_t *ctx, mem_page_t type);
+int ubench_set_seed(ubench_t *ctx, uint64_t seed);
+
+/**
+ * Run on a specific CPU
+ *
+ * The calling thread is pinned to the CPU while allocating and
+ * running, and its previous affinity is restored afterwards.
+ *
+ * @param cpu CPU to run on, -1 to leave the affinity unchanged
+ */
+int ubench_set_cpu(ubench_t *ctx, int cpu);
+
+/**
+ * Allocate and initialize the data set
+ *
+ * Changing the size, line size, page type or pattern after allocating
+ * frees the data set, it has to be allocated again before running.
+ */
+int ubench_alloc(ubench_t *ctx);
+
+/**
+ * Run iterations over the data set
+ *
+ * Every iteration makes one access per line. Results accumulate over
+ * calls until ubench_reset is called.
+ */
+int ubench_run(ubench_t *ctx, unsigned int iterations);
+
+/**
+ * Discard accumulated results
+ */
+void ubench_reset(ubench_t *ctx);
+
+/**
+ * Get the accumulated results
+ */
+int ubench_result(const ubench_t *ctx, ubench_result_t *result);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
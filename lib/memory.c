@@ -28,14 +28,16 @@
  * OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#ifndef MEM_NO_HUGE
 #include <sys/mman.h>
-#else
 #include <stdlib.h>
-#endif
+#include <stdint.h>
+#include <errno.h>
 
 #include "memory.h"
 
+/* Size of a transparent huge page */
+#define THP_SIZE (1 << 21)
+
 /* Round size (upwards) to the nearest multiple of 2 MiB */
 #define ROUND_U(x) (((x) + (1 << 21)) & ~((1 << 21) - 1))
 
@@ -46,6 +48,10 @@
 #define MAP_HUGETLB     0x40000
 #endif
 
+#ifndef MAP_POPULATE
+#define MAP_POPULATE    0x08000
+#endif
+
 #ifndef MEM_NO_HUGE
 
 void *
@@ -82,6 +88,105 @@ mem_huge_free(void *addr, size_t size)
 
 #endif
 
+void *
+mem_alloc(size_t size, mem_page_t type, int flags)
+{
+    const int populate = flags & MEM_POPULATE ? MAP_POPULATE : 0;
+    char *ptr;
+
+    switch (type) {
+    case MEM_PAGE_SMALL:
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+        if (ptr == MAP_FAILED)
+            return NULL;
+#ifdef MADV_NOHUGEPAGE
+        madvise(ptr, size, MADV_NOHUGEPAGE);
+#endif
+        return ptr;
+
+    case MEM_PAGE_THP: {
+        /* Allocate an extra huge page and trim the mapping to make it
+         * huge page aligned. The advice has to be given before the
+         * memory is populated, so MAP_POPULATE can't be used. */
+        const size_t len = ROUND_U(size);
+        char *map;
+        size_t head;
+
+        map = mmap(NULL, len + THP_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED)
+            return NULL;
+
+        head = -(uintptr_t)map & (THP_SIZE - 1);
+        ptr = map + head;
+        if (head)
+            munmap(map, head);
+        munmap(ptr + len, THP_SIZE - head);
+
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, len, MADV_HUGEPAGE);
+#endif
+        if (populate) {
+#ifdef MADV_POPULATE_WRITE
+            if (madvise(ptr, len, MADV_POPULATE_WRITE) == -1) {
+                const int err = errno;
+
+                munmap(ptr, len);
+                errno = err;
+                return NULL;
+            }
+#else
+            munmap(ptr, len);
+            errno = ENOTSUP;
+            return NULL;
+#endif
+        }
+        return ptr;
+    }
+
+    case MEM_PAGE_HUGETLB:
+#ifndef MEM_NO_HUGE
+        ptr = mmap(NULL, ROUND_U(size), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate,
+                   -1, 0);
+        return ptr == MAP_FAILED ? NULL : ptr;
+#else
+        return mem_huge_alloc(size);
+#endif
+
+    default:
+        return NULL;
+    }
+}
+
+void
+mem_free(void *addr, size_t size, mem_page_t type)
+{
+    switch (type) {
+    case MEM_PAGE_SMALL:
+        munmap(addr, size);
+        break;
+
+    case MEM_PAGE_THP:
+        munmap(addr, ROUND_U(size));
+        break;
+
+    case MEM_PAGE_HUGETLB:
+        mem_huge_free(addr, size);
+        break;
+    }
+}
+
+void
+mem_touch(void *addr, size_t size, size_t stride)
+{
+    char *data = addr;
+
+    for (size_t i = 0; i < size; i += stride)
+        data[i] = i & 0xFF;
+}
+
 /*
  * Local Variables:
  * mode: c
@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include "provenance.h"
+#include "bench_argp.h"
+#include "cyclecounter.h"
+/* Generated by the build system */
+#include "build_info.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#define MAX_ENTRIES 32
+#define VALUE_SIZE 256
+
+static struct {
+    const char *name;
+    char value[VALUE_SIZE];
+} entries[MAX_ENTRIES];
+
+static unsigned int nentries = 0;
+static int collected = 0;
+static char line[MAX_ENTRIES * (VALUE_SIZE + 32)];
+
+void
+provenance_add(const char *name, const char *fmt, ...)
+{
+    va_list ap;
+    char *p;
+
+    if (nentries >= MAX_ENTRIES)
+        return;
+
+    va_start(ap, fmt);
+    vsnprintf(entries[nentries].value, VALUE_SIZE, fmt, ap);
+    va_end(ap);
+
+    /* Keep the value on a single line and free from separators */
+    for (p = entries[nentries].value; *p; p++) {
+        if (*p == '\t' || *p == '\n' || *p == ';')
+            *p = ' ';
+    }
+    entries[nentries++].name = name;
+    line[0] = '\0';
+}
+
+/**
+ * Read the first line of a file
+ *
+ * @return 0 on success, -1 if the file could not be read
+ */
+static int
+read_line(const char *path, char *buf, size_t size)
+{
+    FILE *f = fopen(path, "r");
+    int ret = -1;
+
+    if (!f)
+        return -1;
+
+    if (fgets(buf, size, f)) {
+        buf[strcspn(buf, "\n")] = '\0';
+        ret = 0;
+    }
+    fclose(f);
+
+    return ret;
+}
+
+/**
+ * Find a "key : value" line in a file like /proc/cpuinfo or
+ * /proc/meminfo
+ */
+static int
+read_key(const char *path, const char *key, char *buf, size_t size)
+{
+    const size_t key_len = strlen(key);
+    char tmp[512];
+    FILE *f = fopen(path, "r");
+    int ret = -1;
+
+    if (!f)
+        return -1;
+
+    while (fgets(tmp, sizeof(tmp), f)) {
+        char *value;
+
+        if (strncmp(tmp, key, key_len) ||
+            (tmp[key_len] != ':' && tmp[key_len] != ' ' &&
+             tmp[key_len] != '\t'))
+            continue;
+
+        value = strchr(tmp, ':');
+        if (!value)
+            continue;
+        value += strspn(value + 1, " \t") + 1;
+        value[strcspn(value, "\n")] = '\0';
+        snprintf(buf, size, "%s", value);
+        ret = 0;
+        break;
+    }
+    fclose(f);
+
+    return ret;
+}
+
+/**
+ * Extract the selected value, e.g. "[madvise]", from a sysfs file
+ * listing the alternatives
+ */
+static int
+read_selected(const char *path, char *buf, size_t size)
+{
+    char tmp[256];
+    char *start, *end;
+
+    if (read_line(path, tmp, sizeof(tmp)) == -1)
+        return -1;
+
+    start = strchr(tmp, '[');
+    end = start ? strchr(start, ']') : NULL;
+    if (!start || !end) {
+        snprintf(buf, size, "%s", tmp);
+    } else {
+        *end = '\0';
+        snprintf(buf, size, "%s", start + 1);
+    }
+
+    return 0;
+}
+
+static void
+add_file(const char *name, const char *path)
+{
+    char buf[VALUE_SIZE];
+
+    provenance_add(name, "%s",
+                   read_line(path, buf, sizeof(buf)) == 0 ? buf : "unknown");
+}
+
+static void
+add_key(const char *name, const char *path, const char *key)
+{
+    char buf[VALUE_SIZE];
+
+    provenance_add(name, "%s",
+                   read_key(path, key, buf, sizeof(buf)) == 0 ?
+                   buf : "unknown");
+}
+
+static void
+collect_cpu()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    union {
+        unsigned int regs[3];
+        char str[13];
+    } vendor;
+
+    if (__get_cpuid(0, &eax, &vendor.regs[0], &vendor.regs[2],
+                    &vendor.regs[1])) {
+        unsigned int family, model;
+
+        vendor.str[12] = '\0';
+        __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+        family = (eax >> 8) & 0xF;
+        model = (eax >> 4) & 0xF;
+        if (family == 0xF)
+            family += (eax >> 20) & 0xFF;
+        if (family == 0x6 || family >= 0xF)
+            model |= ((eax >> 16) & 0xF) << 4;
+
+        provenance_add("CPUID", "%s family 0x%x model 0x%x stepping 0x%x",
+                       vendor.str, family, model, eax & 0xF);
+    }
+    add_key("CPU model", "/proc/cpuinfo", "model name");
+    add_key("Microcode", "/proc/cpuinfo", "microcode");
+#else
+    char buf[VALUE_SIZE];
+
+    if (read_key("/proc/cpuinfo", "model name", buf, sizeof(buf)) == 0 ||
+        read_key("/proc/cpuinfo", "Hardware", buf, sizeof(buf)) == 0)
+        provenance_add("CPU model", "%s", buf);
+    else
+        provenance_add("CPU model", "unknown");
+    add_key("CPU part", "/proc/cpuinfo", "CPU part");
+    add_key("CPU revision", "/proc/cpuinfo", "CPU revision");
+#endif
+}
+
+static void
+collect_frequency()
+{
+    char buf[VALUE_SIZE];
+
+    add_file("Frequency driver",
+             "/sys/devices/system/cpu/cpu0/cpufreq/scaling_driver");
+    add_file("Frequency governor",
+             "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+
+    if (read_line("/sys/devices/system/cpu/intel_pstate/no_turbo",
+                  buf, sizeof(buf)) == 0)
+        provenance_add("Turbo", "%s", atoi(buf) ? "off" : "on");
+    else if (read_line("/sys/devices/system/cpu/cpufreq/boost",
+                       buf, sizeof(buf)) == 0)
+        provenance_add("Turbo", "%s", atoi(buf) ? "on" : "off");
+    else
+        provenance_add("Turbo", "unknown");
+}
+
+static void
+collect_memory()
+{
+    char enabled[VALUE_SIZE], defrag[VALUE_SIZE];
+    char total[64], nfree[64], size[64];
+
+    if (read_selected("/sys/kernel/mm/transparent_hugepage/enabled",
+                      enabled, sizeof(enabled)) == -1)
+        strcpy(enabled, "unknown");
+    if (read_selected("/sys/kernel/mm/transparent_hugepage/defrag",
+                      defrag, sizeof(defrag)) == -1)
+        strcpy(defrag, "unknown");
+    provenance_add("THP", "enabled=%s defrag=%s", enabled, defrag);
+
+    if (read_key("/proc/meminfo", "HugePages_Total", total,
+                 sizeof(total)) == -1 ||
+        read_key("/proc/meminfo", "HugePages_Free", nfree,
+                 sizeof(nfree)) == -1 ||
+        read_key("/proc/meminfo", "Hugepagesize", size, sizeof(size)) == -1)
+        provenance_add("Huge pages", "unknown");
+    else
+        provenance_add("Huge pages", "total=%s free=%s size=%s",
+                       total, nfree, size);
+
+    add_key("Memory", "/proc/meminfo", "MemTotal");
+}
+
+/**
+ * Describe the CPUs and memory of every online NUMA node
+ */
+static void
+collect_numa()
+{
+    char buf[VALUE_SIZE];
+    char layout[VALUE_SIZE] = "";
+    size_t len = 0;
+    int *nodes;
+    int count;
+
+    if (read_line("/sys/devices/system/node/online", buf, sizeof(buf)) == -1 ||
+        (count = topology_parse_cpu_list(buf, &nodes)) == -1) {
+        provenance_add("NUMA layout", "unknown");
+        return;
+    }
+
+    for (int i = 0; i < count && len < sizeof(layout); i++) {
+        char path[128], key[32], cpus[VALUE_SIZE], mem[64];
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%i/cpulist", nodes[i]);
+        if (read_line(path, cpus, sizeof(cpus)) == -1)
+            strcpy(cpus, "unknown");
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%i/meminfo", nodes[i]);
+        snprintf(key, sizeof(key), "Node %i MemTotal", nodes[i]);
+        if (read_key(path, key, mem, sizeof(mem)) == -1)
+            strcpy(mem, "unknown");
+
+        len += snprintf(layout + len, sizeof(layout) - len,
+                        "%snode%i:cpus=%s,mem=%s", i ? ";" : "",
+                        nodes[i], cpus, mem);
+    }
+    free(nodes);
+
+    provenance_add("NUMA layout", "%s", layout);
+}
+
+static void
+collect_topology()
+{
+    char buf[VALUE_SIZE];
+
+    add_file("Online CPUs", "/sys/devices/system/cpu/online");
+    collect_numa();
+
+    if (read_line("/sys/devices/system/cpu/smt/control",
+                  buf, sizeof(buf)) == 0) {
+        char active[16];
+
+        if (read_line("/sys/devices/system/cpu/smt/active",
+                      active, sizeof(active)) == -1)
+            strcpy(active, "unknown");
+        provenance_add("SMT", "control=%s active=%s", buf, active);
+    } else
+        provenance_add("SMT", "unknown");
+}
+
+static void
+collect_settings()
+{
+    provenance_add("Settings",
+                   "iterations=%u,cache_private=%zu,cache_shared=%zu,"
+                   "line_size=%zu,cpu=%i,placement=%s,ncpus=%u,"
+                   "freq_tolerance=%.2f,freq_reject=%i,quiet=%i,fifo=%i,"
+                   "retries=%u",
+                   bench_settings.iterations, bench_settings.cache_private,
+                   bench_settings.cache_shared, bench_settings.line_size,
+                   bench_settings.cpu,
+                   topology_policy_names[bench_settings.placement],
+                   bench_settings.ncpus, bench_settings.freq_tolerance,
+                   bench_settings.freq_reject, bench_settings.quiet,
+                   bench_settings.fifo_priority, bench_settings.retries);
+    provenance_add("Cycle counter", "%s", cycles_backend_name());
+}
+
+void
+provenance_collect()
+{
+    struct utsname uts;
+
+    if (collected)
+        return;
+    collected = 1;
+
+    if (uname(&uts) == 0) {
+        provenance_add("Host", "%s", uts.nodename);
+        provenance_add("Kernel", "%s %s %s %s",
+                       uts.sysname, uts.release, uts.version, uts.machine);
+    }
+
+    collect_cpu();
+    collect_frequency();
+    collect_memory();
+    collect_topology();
+
+    provenance_add("Compiler", "%s %s", BUILD_CC, __VERSION__);
+    provenance_add("Compiler flags", "%s", BUILD_CFLAGS);
+    provenance_add("Git revision", "%s", BUILD_GIT_REV);
+
+    collect_settings();
+}
+
+void
+provenance_print(FILE *f)
+{
+    for (unsigned int i = 0; i < nentries; i++)
+        fprintf(f, "%s: %s\n", entries[i].name, entries[i].value);
+}
+
+const char *
+provenance_string()
+{
+    if (!line[0]) {
+        size_t len = 0;
+
+        for (unsigned int i = 0; i < nentries && len < sizeof(line); i++)
+            len += snprintf(line + len, sizeof(line) - len, "%s%s=%s",
+                            i ? ";" : "", entries[i].name, entries[i].value);
+    }
+
+    return line;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stats.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+void
+stats_init(stats_t *s)
+{
+    s->n = 0;
+    s->mean = 0.0;
+    s->m2 = 0.0;
+    s->min = INFINITY;
+    s->max = -INFINITY;
+}
+
+void
+stats_add(stats_t *s, double x)
+{
+    const double delta = x - s->mean;
+
+    s->n++;
+    s->mean += delta / s->n;
+    s->m2 += delta * (x - s->mean);
+
+    if (x < s->min)
+        s->min = x;
+    if (x > s->max)
+        s->max = x;
+}
+
+double
+stats_variance(const stats_t *s)
+{
+    return s->n > 1 ? s->m2 / (s->n - 1) : 0.0;
+}
+
+double
+stats_stddev(const stats_t *s)
+{
+    return sqrt(stats_variance(s));
+}
+
+/* Continued fraction for the incomplete beta function, see
+ * Numerical Recipes, section 6.4. */
+static double
+betacf(double a, double b, double x)
+{
+    const double eps = 1E-12;
+    const double fpmin = 1E-300;
+    double c = 1.0;
+    double d = 1.0 - (a + b) * x / (a + 1.0);
+    double h;
+
+    if (fabs(d) < fpmin)
+        d = fpmin;
+    d = 1.0 / d;
+    h = d;
+
+    for (int m = 1; m <= 300; m++) {
+        const int m2 = 2 * m;
+        double aa, del;
+
+        aa = m * (b - m) * x / ((a + m2 - 1) * (a + m2));
+        d = 1.0 + aa * d;
+        if (fabs(d) < fpmin)
+            d = fpmin;
+        c = 1.0 + aa / c;
+        if (fabs(c) < fpmin)
+            c = fpmin;
+        d = 1.0 / d;
+        h *= d * c;
+
+        aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1));
+        d = 1.0 + aa * d;
+        if (fabs(d) < fpmin)
+            d = fpmin;
+        c = 1.0 + aa / c;
+        if (fabs(c) < fpmin)
+            c = fpmin;
+        d = 1.0 / d;
+        del = d * c;
+        h *= del;
+
+        if (fabs(del - 1.0) < eps)
+            break;
+    }
+
+    return h;
+}
+
+/* Regularized incomplete beta function I_x(a, b) */
+static double
+betai(double a, double b, double x)
+{
+    double bt;
+
+    if (x <= 0.0)
+        return 0.0;
+    else if (x >= 1.0)
+        return 1.0;
+
+    bt = exp(lgamma(a + b) - lgamma(a) - lgamma(b) +
+             a * log(x) + b * log(1.0 - x));
+
+    if (x < (a + 1.0) / (a + b + 2.0))
+        return bt * betacf(a, b, x) / a;
+    else
+        return 1.0 - bt * betacf(b, a, 1.0 - x) / b;
+}
+
+double
+stats_welch_p(const stats_t *a, const stats_t *b)
+{
+    double va, vb, se2, t, df;
+
+    if (a->n < 2 || b->n < 2)
+        return 1.0;
+
+    va = stats_variance(a) / a->n;
+    vb = stats_variance(b) / b->n;
+    se2 = va + vb;
+    if (se2 == 0.0)
+        return a->mean == b->mean ? 1.0 : 0.0;
+
+    t = (a->mean - b->mean) / sqrt(se2);
+    df = se2 * se2 /
+        (va * va / (a->n - 1) + vb * vb / (b->n - 1));
+
+    return betai(0.5 * df, 0.5, df / (df + t * t));
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    const uint64_t ua = *(const uint64_t *)a;
+    const uint64_t ub = *(const uint64_t *)b;
+
+    return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+void
+stats_sort_u64(uint64_t *v, size_t n)
+{
+    qsort(v, n, sizeof(*v), compare_u64);
+}
+
+uint64_t
+stats_percentile_u64(const uint64_t *v, size_t n, double p)
+{
+    size_t rank = ceil(p / 100.0 * n);
+
+    if (rank < 1)
+        rank = 1;
+    else if (rank > n)
+        rank = n;
+
+    return v[rank - 1];
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "topology.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+int
+topology_parse_cpu_list(const char *str, int **cpus)
+{
+    const char *p = str;
+    unsigned int count = 0;
+    int *list = NULL;
+
+    while (*p && !isspace(*p)) {
+        char *endptr;
+        long first, last;
+        int *tmp;
+
+        errno = 0;
+        first = last = strtol(p, &endptr, 10);
+        if (!errno && endptr != p && *endptr == '-') {
+            p = endptr + 1;
+            last = strtol(p, &endptr, 10);
+        }
+        if (errno || endptr == p || first < 0 || last < first ||
+            last > INT_MAX ||
+            (*endptr != ',' && *endptr != '\0' && !isspace(*endptr))) {
+            free(list);
+            errno = EINVAL;
+            return -1;
+        }
+
+        tmp = realloc(list, (count + last - first + 1) * sizeof(*list));
+        if (!tmp) {
+            free(list);
+            return -1;
+        }
+        list = tmp;
+        for (long cpu = first; cpu <= last; cpu++)
+            list[count++] = cpu;
+
+        p = *endptr == ',' ? endptr + 1 : endptr;
+    }
+
+    *cpus = list;
+    return count;
+}
+
+int
+topology_siblings(int cpu, int **siblings)
+{
+    char path[128];
+    char buf[256];
+    FILE *f;
+    int ret;
+
+    snprintf(path, sizeof(path),
+             SYSFS_CPU "/cpu%i/topology/thread_siblings_list", cpu);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+
+    if (!fgets(buf, sizeof(buf), f)) {
+        fclose(f);
+        errno = EIO;
+        return -1;
+    }
+    fclose(f);
+
+    ret = topology_parse_cpu_list(buf, siblings);
+    if (ret == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    return ret;
+}
+
+const char *topology_policy_names[] = {
+    "list", "compact", "scatter", "core", NULL
+};
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+    /** Index of the CPU among the listed CPUs of its core */
+    unsigned int thread_rank;
+    /** Index of the core among the listed cores of its package */
+    unsigned int core_rank;
+} place_t;
+
+static int
+read_topology_id(int cpu, const char *name)
+{
+    char path[128];
+    FILE *f;
+    int id;
+
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%i/topology/%s", cpu, name);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (fscanf(f, "%i", &id) != 1)
+        id = -1;
+    fclose(f);
+
+    return id;
+}
+
+static int
+cmp_compact(const void *_a, const void *_b)
+{
+    const place_t *a = _a, *b = _b;
+
+    if (a->package != b->package)
+        return a->package < b->package ? -1 : 1;
+    if (a->core != b->core)
+        return a->core < b->core ? -1 : 1;
+    return a->cpu < b->cpu ? -1 : a->cpu > b->cpu;
+}
+
+static int
+cmp_scatter(const void *_a, const void *_b)
+{
+    const place_t *a = _a, *b = _b;
+
+    if (a->thread_rank != b->thread_rank)
+        return a->thread_rank < b->thread_rank ? -1 : 1;
+    if (a->core_rank != b->core_rank)
+        return a->core_rank < b->core_rank ? -1 : 1;
+    if (a->package != b->package)
+        return a->package < b->package ? -1 : 1;
+    return a->cpu < b->cpu ? -1 : a->cpu > b->cpu;
+}
+
+int
+topology_place(topology_policy_t policy, int *cpus, unsigned int ncpus)
+{
+    place_t *place;
+    unsigned int count = 0;
+
+    if (policy == TOPOLOGY_LIST)
+        return ncpus;
+
+    place = malloc(ncpus * sizeof(*place));
+    if (!place)
+        return -1;
+
+    for (unsigned int i = 0; i < ncpus; i++) {
+        place_t *p = &place[i];
+
+        p->cpu = cpus[i];
+        p->package = read_topology_id(p->cpu, "physical_package_id");
+        p->core = read_topology_id(p->cpu, "core_id");
+        if (p->package == -1 || p->core == -1) {
+            p->package = 0;
+            p->core = -1 - p->cpu;
+        }
+    }
+
+    /* In compact order, the siblings of a core are adjacent and the
+     * cores of a package are adjacent, which makes the ranks easy to
+     * compute. */
+    qsort(place, ncpus, sizeof(*place), cmp_compact);
+    for (unsigned int i = 0; i < ncpus; i++) {
+        place_t *p = &place[i];
+
+        if (i == 0 || p->package != place[i - 1].package) {
+            p->thread_rank = 0;
+            p->core_rank = 0;
+        } else if (p->core != place[i - 1].core) {
+            p->thread_rank = 0;
+            p->core_rank = place[i - 1].core_rank + 1;
+        } else {
+            p->thread_rank = place[i - 1].thread_rank + 1;
+            p->core_rank = place[i - 1].core_rank;
+        }
+    }
+
+    if (policy == TOPOLOGY_SCATTER)
+        qsort(place, ncpus, sizeof(*place), cmp_scatter);
+
+    for (unsigned int i = 0; i < ncpus; i++) {
+        if (policy != TOPOLOGY_CORE || place[i].thread_rank == 0)
+            cpus[count++] = place[i].cpu;
+    }
+
+    free(place);
+    return count;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
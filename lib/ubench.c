@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include "ubench.h"
+#include "access.h"
+#include "rnd_lcg.h"
+#include "stats.h"
+#include "cyclecounter.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+struct ubench {
+    ubench_pattern_t pattern;
+    size_t size;
+    size_t line_size;
+    mem_page_t page_type;
+    int cpu;
+    uint64_t seed;
+
+    char *data;
+    size_t lines;
+    uint64_t rnd_state;
+    void **chase;
+
+    stats_t iter;
+    double wall;
+};
+
+ubench_t *
+ubench_create()
+{
+    ubench_t *ctx = calloc(1, sizeof(*ctx));
+
+    if (!ctx)
+        return NULL;
+
+    ctx->pattern = UBENCH_PATTERN_BLOCK;
+    ctx->size = 16 * 1024 * 1024;
+    ctx->line_size = 64;
+    ctx->page_type = MEM_PAGE_SMALL;
+    ctx->cpu = -1;
+    ctx->seed = 42ULL;
+    stats_init(&ctx->iter);
+
+    return ctx;
+}
+
+static void
+free_data(ubench_t *ctx)
+{
+    if (ctx->data) {
+        mem_free(ctx->data, ctx->size, ctx->page_type);
+        ctx->data = NULL;
+    }
+}
+
+void
+ubench_destroy(ubench_t *ctx)
+{
+    if (!ctx)
+        return;
+
+    free_data(ctx);
+    free(ctx);
+}
+
+int
+ubench_set_pattern(ubench_t *ctx, ubench_pattern_t pattern)
+{
+    if (pattern > UBENCH_PATTERN_CHASE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    free_data(ctx);
+    ctx->pattern = pattern;
+    return 0;
+}
+
+int
+ubench_set_size(ubench_t *ctx, size_t size)
+{
+    if (size < ctx->line_size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    free_data(ctx);
+    ctx->size = size;
+    return 0;
+}
+
+int
+ubench_set_line_size(ubench_t *ctx, size_t line_size)
+{
+    if (line_size < sizeof(void *) || line_size > ctx->size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    free_data(ctx);
+    ctx->line_size = line_size;
+    return 0;
+}
+
+int
+ubench_set_page_type(ubench_t *ctx, mem_page_t type)
+{
+    if (type > MEM_PAGE_HUGETLB) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    free_data(ctx);
+    ctx->page_type = type;
+    return 0;
+}
+
+int
+ubench_set_seed(ubench_t *ctx, uint64_t seed)
+{
+    ctx->seed = seed;
+    return 0;
+}
+
+int
+ubench_set_cpu(ubench_t *ctx, int cpu)
+{
+    if (cpu < -1 || cpu >= CPU_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx->cpu = cpu;
+    return 0;
+}
+
+/**
+ * Pin the calling thread to the context's CPU
+ *
+ * @param old Affinity to restore using unpin
+ */
+static int
+pin(const ubench_t *ctx, cpu_set_t *old)
+{
+    cpu_set_t cpu_set;
+
+    if (ctx->cpu == -1)
+        return 0;
+
+    if (sched_getaffinity(0, sizeof(*old), old) == -1)
+        return -1;
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(ctx->cpu, &cpu_set);
+    return sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+}
+
+static void
+unpin(const ubench_t *ctx, const cpu_set_t *old)
+{
+    if (ctx->cpu != -1)
+        sched_setaffinity(0, sizeof(*old), old);
+}
+
+/**
+ * Link the lines into a single random cycle (Sattolo's algorithm)
+ */
+static int
+init_chase(ubench_t *ctx)
+{
+    size_t *perm = malloc(ctx->lines * sizeof(*perm));
+    uint64_t rnd = ctx->seed;
+
+    if (!perm)
+        return -1;
+
+    for (size_t i = 0; i < ctx->lines; i++)
+        perm[i] = i;
+    for (size_t i = ctx->lines - 1; i > 0; i--) {
+        size_t j, tmp;
+
+        rnd = rnd_lcg64(rnd);
+        j = rnd_range64(rnd, i);
+        tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+
+    for (size_t i = 0; i < ctx->lines; i++)
+        *(void **)(ctx->data + i * ctx->line_size) =
+            ctx->data + perm[i] * ctx->line_size;
+
+    free(perm);
+    ctx->chase = (void **)ctx->data;
+    return 0;
+}
+
+int
+ubench_alloc(ubench_t *ctx)
+{
+    cpu_set_t old;
+    int ret = 0;
+
+    free_data(ctx);
+
+    /* Allocate and touch the data set on the CPU the probe runs on
+     * to get memory that is local to it. */
+    if (pin(ctx, &old) == -1)
+        return -1;
+
+    ctx->data = mem_alloc(ctx->size, ctx->page_type, 0);
+    if (!ctx->data) {
+        ret = -1;
+        goto out;
+    }
+    mem_touch(ctx->data, ctx->size, 1);
+
+    ctx->lines = ctx->size / ctx->line_size;
+    ctx->rnd_state = ctx->seed ? ctx->seed : 1;
+    if (ctx->pattern == UBENCH_PATTERN_CHASE && init_chase(ctx) == -1) {
+        free_data(ctx);
+        ret = -1;
+    }
+
+out:
+    unpin(ctx, &old);
+    return ret;
+}
+
+static void
+iteration(ubench_t *ctx)
+{
+    switch (ctx->pattern) {
+    case UBENCH_PATTERN_BLOCK:
+        for (size_t i = 0; i < ctx->lines; i++)
+            access_rd8(ctx->data + i * ctx->line_size);
+        break;
+
+    case UBENCH_PATTERN_RANDOM: {
+        uint64_t rnd = ctx->rnd_state;
+
+        for (size_t i = 0; i < ctx->lines; i++) {
+            rnd = rnd_xorshift64(rnd);
+            access_rd8(ctx->data + rnd_range64(rnd, ctx->size));
+        }
+        ctx->rnd_state = rnd;
+    } break;
+
+    case UBENCH_PATTERN_CHASE: {
+        void **p = ctx->chase;
+
+        for (size_t i = 0; i < ctx->lines; i++)
+            p = (void **)*p;
+        ctx->chase = p;
+    } break;
+    }
+}
+
+int
+ubench_run(ubench_t *ctx, unsigned int iterations)
+{
+    struct timespec start, stop;
+    cpu_set_t old;
+
+    if (!ctx->data) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (pin(ctx, &old) == -1)
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i = 0; i < iterations; i++) {
+        const uint64_t cycles_start = cycles_get();
+
+        iteration(ctx);
+        stats_add(&ctx->iter, cycles_get() - cycles_start);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    ctx->wall += (stop.tv_sec - start.tv_sec) +
+        (stop.tv_nsec - start.tv_nsec) * 1E-9;
+
+    unpin(ctx, &old);
+    return 0;
+}
+
+void
+ubench_reset(ubench_t *ctx)
+{
+    stats_init(&ctx->iter);
+    ctx->wall = 0.0;
+}
+
+int
+ubench_result(const ubench_t *ctx, ubench_result_t *result)
+{
+    const uint64_t total = ctx->iter.n * ctx->lines;
+
+    if (!ctx->iter.n) {
+        errno = ENODATA;
+        return -1;
+    }
+
+    result->iterations = ctx->iter.n;
+    result->accesses = ctx->lines;
+    result->wall = ctx->wall;
+    result->cycles_mean = ctx->iter.mean;
+    result->cycles_stddev = stats_stddev(&ctx->iter);
+    result->cycles_min = ctx->iter.min;
+    result->cycles_max = ctx->iter.max;
+    result->ns_per_access = ctx->wall * 1E9 / total;
+    result->bytes_per_second = total * ctx->line_size / ctx->wall;
+
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,548 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "expect.h"
+#include "cpu.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "bench_common.h"
+
+#define LINE_ALIGNED __attribute__((aligned(128)))
+
+/* Upper bound of the exponential backoff in the TTAS lock */
+#define TTAS_BACKOFF_MAX 4096
+
+typedef struct {
+    const char *name;
+    void (*init)(unsigned int threads);
+    void (*acquire)(unsigned int id);
+    void (*release)(unsigned int id);
+} lock_t;
+
+/* Test-and-set */
+
+static int tas_lock LINE_ALIGNED;
+
+static void
+tas_init(unsigned int threads)
+{
+    tas_lock = 0;
+}
+
+static void
+tas_acquire(unsigned int id)
+{
+    while (__atomic_exchange_n(&tas_lock, 1, __ATOMIC_ACQUIRE))
+        cpu_relax();
+}
+
+static void
+tas_release(unsigned int id)
+{
+    __atomic_store_n(&tas_lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Test-and-test-and-set with exponential backoff */
+
+static void
+ttas_acquire(unsigned int id)
+{
+    uint64_t backoff = 16;
+
+    while (1) {
+        while (__atomic_load_n(&tas_lock, __ATOMIC_RELAXED))
+            cpu_relax();
+        if (!__atomic_exchange_n(&tas_lock, 1, __ATOMIC_ACQUIRE))
+            return;
+
+        cycles_wait(backoff);
+        if (backoff < TTAS_BACKOFF_MAX)
+            backoff *= 2;
+    }
+}
+
+/* Ticket lock */
+
+static struct {
+    unsigned int next LINE_ALIGNED;
+    unsigned int serving LINE_ALIGNED;
+} ticket;
+
+static void
+ticket_init(unsigned int threads)
+{
+    ticket.next = 0;
+    ticket.serving = 0;
+}
+
+static void
+ticket_acquire(unsigned int id)
+{
+    const unsigned int my =
+        __atomic_fetch_add(&ticket.next, 1, __ATOMIC_RELAXED);
+
+    while (__atomic_load_n(&ticket.serving, __ATOMIC_ACQUIRE) != my)
+        cpu_relax();
+}
+
+static void
+ticket_release(unsigned int id)
+{
+    __atomic_store_n(&ticket.serving, ticket.serving + 1, __ATOMIC_RELEASE);
+}
+
+/* MCS queue lock */
+
+typedef struct mcs_node {
+    struct mcs_node *next;
+    int locked;
+} LINE_ALIGNED mcs_node_t;
+
+static mcs_node_t *mcs_tail LINE_ALIGNED;
+static mcs_node_t *mcs_nodes;
+
+static void
+mcs_init(unsigned int threads)
+{
+    mcs_tail = NULL;
+}
+
+static void
+mcs_acquire(unsigned int id)
+{
+    mcs_node_t *node = &mcs_nodes[id];
+    mcs_node_t *pred;
+
+    node->next = NULL;
+    node->locked = 1;
+    pred = __atomic_exchange_n(&mcs_tail, node, __ATOMIC_ACQ_REL);
+    if (pred) {
+        __atomic_store_n(&pred->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+            cpu_relax();
+    }
+}
+
+static void
+mcs_release(unsigned int id)
+{
+    mcs_node_t *node = &mcs_nodes[id];
+    mcs_node_t *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+    if (!next) {
+        mcs_node_t *expected = node;
+
+        if (__atomic_compare_exchange_n(&mcs_tail, &expected, NULL, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+            cpu_relax();
+    }
+
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* CLH queue lock */
+
+typedef struct {
+    int locked;
+} LINE_ALIGNED clh_node_t;
+
+static clh_node_t *clh_tail LINE_ALIGNED;
+/* One node per thread plus the initial dummy node */
+static clh_node_t *clh_nodes;
+static clh_node_t **clh_mine;
+static clh_node_t **clh_pred;
+
+static void
+clh_init(unsigned int threads)
+{
+    for (unsigned int i = 0; i < threads; i++) {
+        clh_nodes[i].locked = 0;
+        clh_mine[i] = &clh_nodes[i];
+    }
+    clh_nodes[threads].locked = 0;
+    clh_tail = &clh_nodes[threads];
+}
+
+static void
+clh_acquire(unsigned int id)
+{
+    clh_node_t *node = clh_mine[id];
+    clh_node_t *pred;
+
+    node->locked = 1;
+    pred = __atomic_exchange_n(&clh_tail, node, __ATOMIC_ACQ_REL);
+    clh_pred[id] = pred;
+    while (__atomic_load_n(&pred->locked, __ATOMIC_ACQUIRE))
+        cpu_relax();
+}
+
+static void
+clh_release(unsigned int id)
+{
+    __atomic_store_n(&clh_mine[id]->locked, 0, __ATOMIC_RELEASE);
+    /* The predecessor's node is no longer used by anyone, recycle
+     * it as our node for the next acquisition. */
+    clh_mine[id] = clh_pred[id];
+}
+
+/* pthread mutex (futex based on Linux) */
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+mutex_init(unsigned int threads)
+{
+}
+
+static void
+mutex_acquire(unsigned int id)
+{
+    pthread_mutex_lock(&mutex);
+}
+
+static void
+mutex_release(unsigned int id)
+{
+    pthread_mutex_unlock(&mutex);
+}
+
+static const lock_t locks[] = {
+    { "tas", tas_init, tas_acquire, tas_release },
+    { "ttas", tas_init, ttas_acquire, tas_release },
+    { "ticket", ticket_init, ticket_acquire, ticket_release },
+    { "mcs", mcs_init, mcs_acquire, mcs_release },
+    { "clh", clh_init, clh_acquire, clh_release },
+    { "mutex", mutex_init, mutex_acquire, mutex_release },
+    { NULL, NULL, NULL, NULL }
+};
+
+typedef struct {
+    int cpu;
+    unsigned int id;
+    pthread_t thread;
+
+    uint64_t acquisitions;
+    uint64_t handoffs;
+    uint64_t handoff_cycles;
+} LINE_ALIGNED worker_t;
+
+static uint64_t cs_cycles = 100;
+static uint64_t ncs_cycles = 0;
+static double duration = 0.2;
+static int sel_lock = -1;
+
+static worker_t *workers;
+static unsigned int nworkers;
+static pthread_barrier_t start_barrier;
+static pthread_barrier_t done_barrier;
+
+/* Current measurement point, written by the main thread between
+ * barriers. */
+static struct {
+    const lock_t *lock;
+    unsigned int threads;
+    volatile int stop;
+    int quit;
+} point;
+
+/* State protected by the lock under test */
+static struct {
+    uint64_t counter;
+    uint64_t last_release;
+    int last_owner;
+} LINE_ALIGNED shared;
+
+static void
+worker_loop(worker_t *w, const lock_t *lock)
+{
+    while (!point.stop) {
+        uint64_t now;
+
+        lock->acquire(w->id);
+
+        now = cycles_get();
+        if (shared.last_owner != w->id && shared.last_owner != -1) {
+            w->handoffs++;
+            w->handoff_cycles += now - shared.last_release;
+        }
+        shared.counter++;
+        w->acquisitions++;
+        if (cs_cycles)
+            cycles_wait(cs_cycles);
+        shared.last_owner = w->id;
+        shared.last_release = cycles_get();
+
+        lock->release(w->id);
+
+        if (ncs_cycles)
+            cycles_wait(ncs_cycles);
+    }
+}
+
+static void *
+worker_main(void *arg)
+{
+    worker_t *w = arg;
+
+    EXPECT_ERRNO(bench_pin_thread(w->cpu) != -1);
+
+    while (1) {
+        pthread_barrier_wait(&start_barrier);
+        if (point.quit)
+            break;
+
+        w->acquisitions = 0;
+        w->handoffs = 0;
+        w->handoff_cycles = 0;
+        if (w->id < point.threads)
+            worker_loop(w, point.lock);
+
+        pthread_barrier_wait(&done_barrier);
+    }
+
+    return NULL;
+}
+
+static void
+measure(const lock_t *lock, unsigned int threads)
+{
+    const struct timespec ts = {
+        (time_t)duration, (long)((duration - (time_t)duration) * 1E9)
+    };
+    uint64_t total = 0, handoffs = 0, handoff_cycles = 0;
+    uint64_t min = UINT64_MAX, max = 0;
+    double sum_sq = 0.0;
+    timing_t t;
+
+    lock->init(threads);
+    shared.counter = 0;
+    shared.last_owner = -1;
+    point.lock = lock;
+    point.threads = threads;
+    point.stop = 0;
+
+    timing_init(&t);
+    pthread_barrier_wait(&start_barrier);
+    timing_start(&t);
+    nanosleep(&ts, NULL);
+    point.stop = 1;
+    pthread_barrier_wait(&done_barrier);
+    timing_stop(&t);
+
+    for (unsigned int i = 0; i < threads; i++) {
+        const worker_t *w = &workers[i];
+
+        total += w->acquisitions;
+        handoffs += w->handoffs;
+        handoff_cycles += w->handoff_cycles;
+        sum_sq += (double)w->acquisitions * w->acquisitions;
+        if (w->acquisitions < min)
+            min = w->acquisitions;
+        if (w->acquisitions > max)
+            max = w->acquisitions;
+    }
+
+    /* A broken lock would lose updates to the shared counter */
+    EXPECT(shared.counter == total);
+
+    /* Jain's fairness index: 1.0 if all threads got the lock equally
+     * often, 1/threads if one thread got it every time. */
+    printf("%-8s %7u %12.3f %10.1f %8.3f %10" PRIu64 " %10" PRIu64 "\n",
+           lock->name, threads, total / t.acc * 1E-6,
+           handoffs ? (double)handoff_cycles / handoffs : 0.0,
+           sum_sq > 0.0 ? (double)total * total / (threads * sum_sq) : 0.0,
+           min, max);
+}
+
+static void
+init()
+{
+    nworkers = bench_settings.ncpus;
+    EXPECT(posix_memalign((void **)&workers, 128,
+                          nworkers * sizeof(*workers)) == 0);
+    memset(workers, 0, nworkers * sizeof(*workers));
+
+    EXPECT(posix_memalign((void **)&mcs_nodes, 128,
+                          nworkers * sizeof(*mcs_nodes)) == 0);
+    EXPECT(posix_memalign((void **)&clh_nodes, 128,
+                          (nworkers + 1) * sizeof(*clh_nodes)) == 0);
+    clh_mine = calloc(nworkers, sizeof(*clh_mine));
+    clh_pred = calloc(nworkers, sizeof(*clh_pred));
+    EXPECT_ERRNO(clh_mine != NULL && clh_pred != NULL);
+
+    EXPECT(pthread_barrier_init(&start_barrier, NULL, nworkers + 1) == 0);
+    EXPECT(pthread_barrier_init(&done_barrier, NULL, nworkers + 1) == 0);
+    for (unsigned int i = 0; i < nworkers; i++) {
+        worker_t *w = &workers[i];
+
+        w->cpu = bench_settings.cpus[i];
+        w->id = i;
+        EXPECT(pthread_create(&w->thread, NULL, worker_main, w) == 0);
+    }
+}
+
+static void
+run()
+{
+    printf("%-8s %7s %12s %10s %8s %10s %10s\n",
+           "Lock", "Threads", "Macq/s", "Handoff", "Fairness", "Min", "Max");
+
+    for (int l = 0; locks[l].name; l++) {
+        if (sel_lock != -1 && sel_lock != l)
+            continue;
+
+        for (unsigned int threads = 1; threads <= nworkers; threads++)
+            measure(&locks[l], threads);
+    }
+
+    point.quit = 1;
+    pthread_barrier_wait(&start_barrier);
+    for (unsigned int i = 0; i < nworkers; i++)
+        EXPECT(pthread_join(workers[i].thread, NULL) == 0);
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'l':
+        for (sel_lock = 0; locks[sel_lock].name; sel_lock++) {
+            if (!strcmp(locks[sel_lock].name, arg))
+                break;
+        }
+        if (!locks[sel_lock].name)
+            argp_error(state, "Invalid lock: '%s'.\n", arg);
+        break;
+
+    case 'w':
+        cs_cycles = argp_parse_uint64(state, "critical section", arg);
+        break;
+
+    case 'n':
+        ncs_cycles = argp_parse_uint64(state, "non-critical section", arg);
+        break;
+
+    case 't':
+        duration = argp_parse_double(state, "duration", arg);
+        if (duration <= 0.0)
+            argp_error(state, "Invalid duration: Must be positive.\n");
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "locks";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "lock", 'l', "NAME", 0,
+      "Only measure tas, ttas, ticket, mcs, clh or mutex", 0 },
+    { "cs", 'w', "CYCLES", 0,
+      "Critical section length in cycles (default: 100)", 0 },
+    { "ncs", 'n', "CYCLES", 0,
+      "Cycles to wait between releasing and acquiring (default: 0)", 0 },
+    { "duration", 't', "SEC", 0,
+      "Measure each point for SEC seconds (default: 0.2)", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Measure lock throughput, handoff latency and fairness"
+    "\v"
+    "This microbenchmark runs pinned threads that repeatedly acquire a lock, "
+    "spin for the length of the critical section and release the lock. The "
+    "number of threads is swept from one to the number of CPUs in the CPU "
+    "list. For every lock and thread count, the total number of acquisitions "
+    "per second, the average handoff latency (cycles from a release to the "
+    "next acquisition by another thread), Jain's fairness index and the "
+    "smallest and largest number of acquisitions of a thread are reported. "
+    "Handoff latencies compare cycle counters on different CPUs and are only "
+    "meaningful if the counters are synchronized.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    printf("Critical section: %" PRIu64 " cycles\n", cs_cycles);
+    printf("Non-critical section: %" PRIu64 " cycles\n", ncs_cycles);
+    printf("Threads: %u\n", nworkers);
+    bench_param_placement();
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 #include <argp.h>
 #include <errno.h>
 
@@ -40,66 +41,314 @@
 #include "bench_argp.h"
 #include "argp_utils.h"
 #include "access.h"
+#include "timing.h"
+#include "cyclecounter.h"
 #include "bench_common.h"
 
 static size_t bench_size = 16*1024*1024;
-static size_t bench_size_mask = 16*1024*1024 - 1;
 
 static size_t bench_distance = SIZE_MAX;
 static uint16_t bench_streams = 3;
+static uint16_t sweep_max = 0;
+static double sweep_jump = 30.0;
+
+typedef struct {
+    /** Distance between accesses in bytes, 0 for the line size */
+    size_t stride;
+    /** Set to walk towards lower addresses */
+    int down;
+    /** Start offset, SIZE_MAX for the stream number times the
+     * stream distance */
+    size_t offset;
+    /** Accesses per step */
+    unsigned int rate;
+
+    /** Start position */
+    size_t start;
+    /** Amount to add to the position (modulo the data size) */
+    size_t step;
+    size_t pos;
+} stream_t;
+
+static stream_t *streams;
+/** Number of streams configured using --stream */
+static uint16_t nconfigured = 0;
+static size_t steps;
 
 static char *data;
 
-#define ACCESS access_rd8
+/* Measured iterations per stream count in sweeps */
+#define SWEEP_REPEAT 3
+
+#define STREAM_ITERATION(arg, name, bytes)                              \
+    static void                                                         \
+    iteration_ ## name()                                                \
+    {                                                                   \
+        char *const base = data + bench_settings.access_offset;         \
+                                                                        \
+        for (uint16_t j = 0; j < bench_streams; j++)                    \
+            streams[j].pos = streams[j].start;                          \
+                                                                        \
+        for (size_t i = 0; i < steps; i++) {                            \
+            for (uint16_t j = 0; j < bench_streams; j++) {              \
+                stream_t *s = &streams[j];                              \
+                                                                        \
+                for (unsigned int k = 0; k < s->rate; k++) {            \
+                    access_ ## name(base + s->pos);                     \
+                    s->pos += s->step;                                  \
+                    if (s->pos >= bench_size)                           \
+                        s->pos -= bench_size;                           \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+        access_finish(bytes);                                           \
+    }
+
+ACCESS_PRIMITIVES(STREAM_ITERATION, )
+
+#define ITERATION_ENTRY(arg, name, bytes) iteration_ ## name,
+
+static void (*const iterations[ACCESS_COUNT])() = {
+    ACCESS_PRIMITIVES(ITERATION_ENTRY, )
+};
+
+static void (*bench_iteration)();
+
+RUN_BENCH(run_bench, bench_iteration);
+
+/**
+ * Start position of stream j
+ */
+static size_t
+stream_start(const stream_t *s, uint16_t j)
+{
+    const size_t offset =
+        s->offset != SIZE_MAX ? s->offset : bench_distance * j;
+
+    return offset % bench_size;
+}
+
+/**
+ * Compute the start position and step of the first count streams
+ *
+ * @return Accesses per iteration
+ */
+static uint64_t
+setup_streams(uint16_t count)
+{
+    uint64_t accesses = 0;
+
+    bench_streams = count;
+    for (uint16_t j = 0; j < count; j++) {
+        stream_t *s = &streams[j];
+        const size_t stride =
+            (s->stride ? s->stride : bench_settings.line_size) % bench_size;
+
+        s->start = stream_start(s, j);
+        s->step = s->down && stride ? bench_size - stride : stride;
+        accesses += s->rate;
+    }
+
+    return accesses * steps;
+}
 
-static inline void
-bench_iteration()
+static double
+sweep_measure()
 {
-    const size_t line_size = bench_settings.line_size;
-    for (size_t i = 0; i < bench_size; i += line_size) {
-	for (uint16_t j = 0; j < bench_streams; j++)
-	    ACCESS(data +
-		   ((i + bench_distance * j) & bench_size_mask));
+    uint64_t best = UINT64_MAX;
+
+    /* The first iteration warms the caches and is not measured */
+    for (unsigned int r = 0; r <= SWEEP_REPEAT; r++) {
+        const uint64_t start = cycles_get();
+        uint64_t cycles;
+
+        bench_iteration();
+        cycles = cycles_get() - start;
+        if (r && cycles < best)
+            best = cycles;
     }
+
+    return best;
 }
 
-RUN_BENCH(run_bench, bench_iteration);
+/**
+ * Sweep the number of streams
+ *
+ * Adding streams increases the memory-level parallelism as long as
+ * the prefetchers can track them. Report the largest number of
+ * streams, starting from the cheapest configuration, whose cost per
+ * access stays within the jump threshold of the cheapest one.
+ */
+static int
+run_sweep()
+{
+    double cost[sweep_max];
+    uint16_t best = 0, tracked;
+
+    printf("%8s %14s %10s\n", "Streams", "Cycles/access", "MB/s");
+    for (uint16_t n = 1; n <= sweep_max; n++) {
+        const uint64_t accesses = setup_streams(n);
+        const double cycles = sweep_measure();
+        timing_t t;
+
+        timing_init(&t);
+        timing_start(&t);
+        bench_iteration();
+        timing_stop(&t);
+
+        cost[n - 1] = cycles / accesses;
+        if (cost[n - 1] < cost[best])
+            best = n - 1;
+
+        printf("%8" PRIu16 " %14.2f %10.1f\n", n, cost[n - 1],
+               accesses * bench_settings.line_size / t.acc * 1E-6);
+    }
+
+    for (tracked = best + 1; tracked < sweep_max; tracked++) {
+        if (cost[tracked] > cost[best] * (1.0 + sweep_jump / 100.0))
+            break;
+    }
+    printf("Lowest cost: %" PRIu16 " streams\n", best + 1);
+    printf("Tracked streams: %" PRIu16 "\n", tracked);
+
+    return 0;
+}
 
 static void
 init()
 {
+    const uint16_t max_streams = sweep_max ? sweep_max : bench_streams;
+    uint64_t accesses;
+
     if (bench_distance == SIZE_MAX)
         bench_distance = bench_settings.cache_private * 1.5;
 
+    if (nconfigured > max_streams) {
+        fprintf(stderr, "More streams configured than used.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    streams = realloc(streams, max_streams * sizeof(*streams));
+    EXPECT_ERRNO(streams != NULL);
+    for (uint16_t j = nconfigured; j < max_streams; j++) {
+        streams[j].stride = 0;
+        streams[j].down = 0;
+        streams[j].offset = SIZE_MAX;
+        streams[j].rate = 1;
+    }
 
     EXPECT_ERRNO(bench_pin_cpu() != -1);
 
-    data = mem_huge_alloc(bench_size);
+    data = mem_huge_alloc(bench_size + bench_access_slack());
     EXPECT_ERRNO(data != NULL);
-    for (int i = 0; i < bench_size; i++)
-	data[i] = i & 0xFF;
+    bench_set_data(data, bench_size + bench_access_slack());
+    bench_iteration = iterations[access_index(bench_settings.access_width,
+                                              bench_settings.access_store)];
+    mem_touch(data, bench_size + bench_access_slack(), 1);
+
+    steps =
+        (bench_size + bench_settings.line_size - 1) / bench_settings.line_size;
+
+    /* Sweeps set up their streams for every measurement, the array
+     * may be smaller than the default number of streams */
+    if (!sweep_max) {
+        accesses = setup_streams(bench_streams);
+        bench_set_work(accesses, accesses * bench_settings.line_size);
+    }
+}
+
+/**
+ * Parse a stream description of the form
+ * stride=SIZE,dir=up|down,offset=SIZE,rate=NUM
+ */
+static void
+parse_stream(struct argp_state *state, char *arg)
+{
+    stream_t s = {
+        .stride = 0,
+        .down = 0,
+        .offset = SIZE_MAX,
+        .rate = 1,
+    };
+    char *saveptr;
+
+    for (char *tok = strtok_r(arg, ",", &saveptr); tok;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        char *value = strchr(tok, '=');
+
+        if (!value)
+            argp_error(state, "Invalid stream parameter: %s\n", tok);
+        *value++ = '\0';
+
+        if (!strcmp(tok, "stride")) {
+            s.stride = argp_parse_size(state, "stride", value);
+        } else if (!strcmp(tok, "dir")) {
+            if (!strcmp(value, "up"))
+                s.down = 0;
+            else if (!strcmp(value, "down"))
+                s.down = 1;
+            else
+                argp_error(state, "Invalid direction: %s\n", value);
+        } else if (!strcmp(tok, "offset")) {
+            s.offset = argp_parse_size(state, "offset", value);
+        } else if (!strcmp(tok, "rate")) {
+            s.rate = argp_parse_uint(state, "rate", value);
+            if (!s.rate)
+                argp_error(state, "Invalid rate: Must not be 0.\n");
+        } else
+            argp_error(state, "Invalid stream parameter: %s\n", tok);
+    }
+
+    streams = realloc(streams, (nconfigured + 1) * sizeof(*streams));
+    if (!streams)
+        argp_failure(state, EXIT_FAILURE, errno, "realloc");
+    streams[nconfigured++] = s;
 }
 
 static error_t
 parse_opt (int key, char *arg, struct argp_state *state)
 {
-    long l_arg;
-
     switch (key)
     {
     case 's':
         bench_streams = argp_parse_uint16(state, "streams", arg);
+        if (!bench_streams)
+            argp_error(state, "Invalid number of streams.\n");
         break;
 
     case 'd':
         bench_distance = argp_parse_size(state, "distance", arg);
         break;
 
+    case 'S':
+        bench_size = argp_parse_size(state, "size", arg);
+        if (!bench_size)
+            argp_error(state, "Invalid size: Must not be 0.\n");
+        break;
+
+    case 'p':
+        parse_stream(state, arg);
+        break;
+
+    case 'w':
+        sweep_max = argp_parse_uint16(state, "maximum streams", arg);
+        if (!sweep_max)
+            argp_error(state, "Invalid number of streams.\n");
+        break;
+
+    case 'j':
+        sweep_jump = argp_parse_double(state, "jump", arg);
+        if (sweep_jump <= 0.0)
+            argp_error(state, "Invalid jump: Must be positive.\n");
+        break;
+
     case ARGP_KEY_ARG:
 	argp_usage(state);
         break;
 
     case ARGP_KEY_END:
+        if (nconfigured > bench_streams)
+            bench_streams = nconfigured;
         break;
 
     default:
@@ -117,6 +366,18 @@ const char *argp_program_bug_address =
 static struct argp_option arg_options[] = {
     { "streams", 's', "NUM", 0, "Use NUM streams", 0 },
     { "distance", 'd', "NUM", 0, "Stream distance in bytes", 0 },
+    { "size", 'S', "SIZE", 0, "Data set size (default: 16 MiB)", 0 },
+    { "stream", 'p', "SPEC", 0,
+      "Configure the next stream, SPEC is a comma-separated list of "
+      "stride=SIZE, dir=up|down, offset=SIZE and rate=NUM. May be given "
+      "multiple times", 0 },
+    { "sweep", 'w', "NUM", 0,
+      "Sweep the number of streams from 1 to NUM instead of running the "
+      "benchmark", 0 },
+    { "jump", 'j', "PCT", 0,
+      "Increase in cycles per access (in percent) over the cheapest "
+      "stream count that ends the range of tracked streams in a sweep "
+      "(default: 30)", 0 },
     { 0 }
 };
 
@@ -133,18 +394,46 @@ static struct argp argp = {
     "\v"
     "This microbenchmark accesses memory in multiple streams sequential "
     "streams. Each stream is has a distance of 1.5x the private cache size "
-    "of a core by default.",
+    "of a core by default. Streams configured using --stream can have "
+    "their own stride, direction, start offset and rate, where the rate "
+    "is the number of accesses a stream makes for every access of a "
+    "stream with rate 1. Streams wrap around at the end of the data "
+    "set, which does not need to be a power of two. The sweep mode "
+    "increases the number of streams until the cost per access jumps, "
+    "which shows how many streams the prefetchers can track.",
     .children = arg_children,
 };
 
 int
 main(int argc, char *argv[])
 {
+    bench_argp_run_bench = 1;
     argp_parse (&argp, argc, argv, 0, 0, NULL);
 
     init();
-    run_bench();
-    return 0;
+
+    bench_param("Data size", "%zu", bench_size);
+    if (sweep_max)
+        bench_param("Maximum streams", "%" PRIu16, sweep_max);
+    else
+        bench_param("Streams", "%" PRIu16, bench_streams);
+    bench_param("Stream distance", "%zu", bench_distance);
+    for (uint16_t j = 0; j < nconfigured; j++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "Stream %" PRIu16, j);
+        bench_param(name, "stride=%zu,dir=%s,offset=%zu,rate=%u",
+                    streams[j].stride ? streams[j].stride :
+                    bench_settings.line_size,
+                    streams[j].down ? "down" : "up",
+                    stream_start(&streams[j], j), streams[j].rate);
+    }
+
+    if (sweep_max)
+        return run_sweep();
+
+    printf("Iterations: %u\n", bench_settings.iterations);
+    return run_bench();
 }
 
 /*
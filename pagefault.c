@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "expect.h"
+#include "memory.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "bench_common.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static const struct {
+    const char *name;
+    mem_page_t type;
+    size_t page_size;
+} types[] = {
+    { "4k", MEM_PAGE_SMALL, 4096 },
+    { "thp", MEM_PAGE_THP, HUGE_PAGE_SIZE },
+    { "hugetlb", MEM_PAGE_HUGETLB, HUGE_PAGE_SIZE },
+    { NULL, 0, 0 }
+};
+
+typedef struct {
+    /** Number of pages of the mapping's page size */
+    size_t pages;
+    /** Minor faults reported by getrusage */
+    long faults;
+    uint64_t cycles;
+    double time;
+} result_t;
+
+typedef struct {
+    int cpu;
+    pthread_t thread;
+    char *data;
+    size_t size;
+    result_t result;
+} worker_t;
+
+static size_t bench_size = 256 * 1024 * 1024;
+static size_t stride = 4096;
+static int sel_type = -1;
+static int mt_type = MEM_PAGE_SMALL;
+static pthread_barrier_t barrier;
+
+static long
+minor_faults()
+{
+    struct rusage ru;
+
+    EXPECT_ERRNO(getrusage(RUSAGE_THREAD, &ru) == 0);
+    return ru.ru_minflt;
+}
+
+static void
+touch(char *data, size_t size, result_t *r)
+{
+    const long faults = minor_faults();
+    uint64_t start;
+    timing_t t;
+
+    timing_init(&t);
+    timing_start(&t);
+    start = cycles_get();
+    mem_touch(data, size, stride);
+    r->cycles = cycles_get() - start;
+    timing_stop(&t);
+    r->time = t.acc;
+    r->faults = minor_faults() - faults;
+}
+
+static void
+print_result(const char *type, const char *mode, const result_t *r)
+{
+    printf("%-8s %-9s %10zu %10ld %10.4f %12.0f %12.0f %8.2f\n",
+           type, mode, r->pages, r->faults, r->time,
+           r->pages / r->time,
+           (double)r->cycles / r->pages,
+           bench_size / r->time * 1E-9);
+}
+
+static void
+measure_type(int t)
+{
+    const mem_page_t type = types[t].type;
+    const size_t pages =
+        (bench_size + types[t].page_size - 1) / types[t].page_size;
+    result_t r = { .pages = pages };
+    uint64_t start;
+    timing_t tm;
+    char *data;
+    long faults;
+
+    /* Lazy faulting on first touch */
+    data = mem_alloc(bench_size, type, 0);
+    if (!data) {
+        printf("%-8s %s\n", types[t].name, "unavailable");
+        return;
+    }
+    touch(data, bench_size, &r);
+    print_result(types[t].name, "lazy", &r);
+
+    /* Drop the pages and fault them in again */
+    if (madvise(data, bench_size, MADV_DONTNEED) == 0) {
+        touch(data, bench_size, &r);
+        print_result(types[t].name, "refault", &r);
+    } else {
+        printf("%-8s %-9s %s\n", types[t].name, "refault", "unsupported");
+    }
+    mem_free(data, bench_size, type);
+
+    /* Populate the page tables when mapping */
+    faults = minor_faults();
+    timing_init(&tm);
+    timing_start(&tm);
+    start = cycles_get();
+    data = mem_alloc(bench_size, type, MEM_POPULATE);
+    r.cycles = cycles_get() - start;
+    timing_stop(&tm);
+    r.time = tm.acc;
+    r.faults = minor_faults() - faults;
+    if (!data) {
+        printf("%-8s %-9s %s\n", types[t].name, "populate", "unavailable");
+        return;
+    }
+    print_result(types[t].name, "populate", &r);
+
+    /* ... and touch them afterwards, which should not fault */
+    touch(data, bench_size, &r);
+    print_result(types[t].name, "populated", &r);
+    mem_free(data, bench_size, type);
+}
+
+static void *
+worker_main(void *arg)
+{
+    worker_t *w = arg;
+
+    EXPECT_ERRNO(bench_pin_thread(w->cpu) != -1);
+    pthread_barrier_wait(&barrier);
+    touch(w->data, w->size, &w->result);
+
+    return NULL;
+}
+
+/**
+ * Fault in one mapping from several threads
+ *
+ * Every thread touches its own slice of a shared mapping, which makes
+ * the threads contend for the mmap lock and the page table locks.
+ */
+static void
+measure_threads(unsigned int threads)
+{
+    const size_t page_size = types[mt_type].page_size;
+    size_t slice = bench_size / threads;
+    worker_t workers[threads];
+    uint64_t cycles = 0;
+    long faults = 0;
+    timing_t t;
+    char *data;
+
+    slice -= slice % page_size;
+    data = mem_alloc(bench_size, types[mt_type].type, 0);
+    if (!data) {
+        printf("%-8s %7u %s\n", types[mt_type].name, threads, "unavailable");
+        return;
+    }
+
+    EXPECT(pthread_barrier_init(&barrier, NULL, threads + 1) == 0);
+    for (unsigned int i = 0; i < threads; i++) {
+        workers[i].cpu = bench_settings.cpus[i];
+        workers[i].data = data + i * slice;
+        workers[i].size = slice;
+        EXPECT(pthread_create(&workers[i].thread, NULL,
+                              worker_main, &workers[i]) == 0);
+    }
+
+    timing_init(&t);
+    pthread_barrier_wait(&barrier);
+    timing_start(&t);
+    for (unsigned int i = 0; i < threads; i++) {
+        EXPECT(pthread_join(workers[i].thread, NULL) == 0);
+        cycles += workers[i].result.cycles;
+        faults += workers[i].result.faults;
+    }
+    timing_stop(&t);
+    EXPECT(pthread_barrier_destroy(&barrier) == 0);
+
+    printf("%-8s %7u %10ld %10.4f %12.0f %12.0f\n",
+           types[mt_type].name, threads, faults, t.acc,
+           faults / t.acc, faults ? (double)cycles / faults : 0.0);
+
+    mem_free(data, bench_size, types[mt_type].type);
+}
+
+static void
+run()
+{
+    printf("%-8s %-9s %10s %10s %10s %12s %12s %8s\n",
+           "Type", "Mode", "Pages", "Faults", "Time", "Pages/s",
+           "Cycles/page", "GB/s");
+    for (int t = 0; types[t].name; t++) {
+        if (sel_type == -1 || sel_type == t)
+            measure_type(t);
+    }
+
+    printf("%-8s %7s %10s %10s %12s %12s\n",
+           "Type", "Threads", "Faults", "Time", "Faults/s", "Cycles/fault");
+    for (unsigned int threads = 1; threads <= bench_settings.ncpus;
+         threads++)
+        measure_threads(threads);
+}
+
+static int
+parse_type(struct argp_state *state, const char *arg)
+{
+    for (int t = 0; types[t].name; t++) {
+        if (!strcmp(types[t].name, arg))
+            return t;
+    }
+
+    argp_error(state, "Invalid page type: '%s'.\n", arg);
+    return -1;
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 's':
+        bench_size = argp_parse_size(state, "size", arg);
+        break;
+
+    case 'S':
+        stride = argp_parse_size(state, "stride", arg);
+        if (!stride)
+            argp_error(state, "Invalid stride: Must not be 0.\n");
+        break;
+
+    case 't':
+        sel_type = parse_type(state, arg);
+        mt_type = sel_type;
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "pagefault";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "size", 's', "SIZE", 0, "Mapping size (default: 256 MiB)", 0 },
+    { "stride", 'S', "SIZE", 0,
+      "Distance between writes when touching memory (default: 4096)", 0 },
+    { "type", 't', "NAME", 0,
+      "Only measure 4k, thp or hugetlb pages (default: all, 4k when "
+      "faulting from multiple threads)", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Measure the cost of populating memory"
+    "\v"
+    "This microbenchmark measures how long it takes to back anonymous "
+    "memory with 4 KiB pages, transparent huge pages and hugetlbfs pages. "
+    "For every page type, memory is faulted in lazily by touching it, "
+    "faulted in again after madvise(MADV_DONTNEED), populated when mapped "
+    "and finally touched after being populated. Faults are counted using "
+    "getrusage. The last table shows how faulting scales when the threads "
+    "in the CPU list fault in separate parts of the same mapping.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    EXPECT_ERRNO(bench_pin_cpu() != -1);
+
+    bench_param("Data size", "%zu", bench_size);
+    bench_param("Stride", "%zu", stride);
+    bench_param_placement();
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
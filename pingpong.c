@@ -45,19 +45,30 @@
 static size_t bench_size = 4*1024*1024;
 static char *data;
 
-#define ACCESS access_rd8
+#define PINGPONG_ITERATION(arg, name, bytes)                            \
+    static void                                                         \
+    iteration_ ## name()                                                \
+    {                                                                   \
+        const long line_size = bench_settings.line_size;                \
+        char *const base = data + bench_settings.access_offset;         \
+                                                                        \
+        for (long i = 0; i < bench_size; i += line_size)                \
+            access_ ## name(base + i);                                  \
+                                                                        \
+        for (long i = bench_size - line_size; i >= 0; i -= line_size)   \
+            access_ ## name(base + i);                                  \
+        access_finish(bytes);                                           \
+    }
 
-static inline void
-bench_iteration()
-{
-    const long line_size = bench_settings.line_size;
+ACCESS_PRIMITIVES(PINGPONG_ITERATION, )
 
-    for (long i = 0; i < bench_size; i += line_size)
-        ACCESS(data + i);
+#define ITERATION_ENTRY(arg, name, bytes) iteration_ ## name,
 
-    for (long i = bench_size - line_size; i >= 0; i -= line_size)
-        ACCESS(data + i);
-}
+static void (*const iterations[ACCESS_COUNT])() = {
+    ACCESS_PRIMITIVES(ITERATION_ENTRY, )
+};
+
+static void (*bench_iteration)();
 
 RUN_BENCH(run_bench, bench_iteration);
 
@@ -66,10 +77,16 @@ init()
 {
     EXPECT_ERRNO(bench_pin_cpu() != -1);
 
-    data = mem_huge_alloc(bench_size);
+    data = mem_huge_alloc(bench_size + bench_access_slack());
     EXPECT_ERRNO(data != NULL);
-    for (int i = 0; i < bench_size; i++)
-	data[i] = i & 0xFF;
+    bench_set_data(data, bench_size + bench_access_slack());
+    bench_iteration = iterations[access_index(bench_settings.access_width,
+                                              bench_settings.access_store)];
+    mem_touch(data, bench_size + bench_access_slack(), 1);
+
+    const size_t lines =
+        (bench_size + bench_settings.line_size - 1) / bench_settings.line_size;
+    bench_set_work(2 * lines, 2 * lines * bench_settings.line_size);
 }
 
 static error_t
@@ -126,11 +143,15 @@ static struct argp argp = {
 int
 main(int argc, char *argv[])
 {
+    bench_argp_run_bench = 1;
     argp_parse (&argp, argc, argv, 0, 0, NULL);
 
     init();
-    run_bench();
-    return 0;
+
+    bench_param("Data size", "%zu", bench_size);
+    printf("Iterations: %u\n", bench_settings.iterations);
+
+    return run_bench();
 }
 
 /*
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 #include <argp.h>
 #include <errno.h>
 
@@ -45,38 +46,132 @@
 
 static size_t bench_size = 4*1024*1024;
 static char *data;
-static uint64_t lcg_state = 42ULL;
-
-#define ACCESS access_rd8
+static uint64_t seed = 42ULL;
+static uint64_t lcg_state;
+static uint64_t xorshift_state;
+static rnd_xoshiro256_t xoshiro_state;
+static uint64_t pcg_state;
+static uint64_t *batch;
+static size_t lines;
 
+/*
+ * The generators return the start of a random line, the access
+ * offset is added by the iteration. The LCG keeps selecting bytes
+ * modulo the data set size, rounded down to their line, to stay
+ * comparable with results from older versions. The low bits of the
+ * LCG have a short period and must not be used to select lines.
+ */
 static inline char *
-next_address()
+next_lcg(size_t i __attribute__((unused)))
 {
     lcg_state = rnd_lcg64(lcg_state);
 
-    return data + (lcg_state % bench_size);
+    return data + (lcg_state % bench_size) / bench_settings.line_size *
+        bench_settings.line_size;
 }
 
-static inline void
-bench_iteration()
+static inline char *
+next_xorshift(size_t i __attribute__((unused)))
 {
-    const long line_size = bench_settings.line_size;
+    xorshift_state = rnd_xorshift64(xorshift_state);
 
-    for (long i = 0; i < bench_size; i += line_size)
-        ACCESS(next_address());
+    return data + rnd_range64(xorshift_state, lines) *
+        bench_settings.line_size;
 }
 
+static inline char *
+next_xoshiro(size_t i __attribute__((unused)))
+{
+    return data + rnd_range64(rnd_xoshiro256(&xoshiro_state), lines) *
+        bench_settings.line_size;
+}
+
+static inline char *
+next_pcg(size_t i __attribute__((unused)))
+{
+    return data + rnd_range64(rnd_pcg64(&pcg_state), lines) *
+        bench_settings.line_size;
+}
+
+/* The batch generator fills the address buffer once before the
+ * benchmark starts, every iteration uses the same addresses. The
+ * access index is only used by this generator. */
+static inline char *
+next_batch(size_t i)
+{
+    return data + batch[i];
+}
+
+#define GEN_ITERATION(gen, name, bytes)                                 \
+    static void                                                         \
+    iteration_ ## gen ## _ ## name()                                    \
+    {                                                                   \
+        const size_t offset = bench_settings.access_offset;             \
+        for (size_t i = 0; i < lines; i++)                              \
+            access_ ## name(next_ ## gen(i) + offset);                  \
+        access_finish(bytes);                                           \
+    }
+
+ACCESS_PRIMITIVES(GEN_ITERATION, lcg)
+ACCESS_PRIMITIVES(GEN_ITERATION, xorshift)
+ACCESS_PRIMITIVES(GEN_ITERATION, xoshiro)
+ACCESS_PRIMITIVES(GEN_ITERATION, pcg)
+ACCESS_PRIMITIVES(GEN_ITERATION, batch)
+
+#define GEN_ENTRY(gen, name, bytes) iteration_ ## gen ## _ ## name,
+#define GEN(gen) { #gen, { ACCESS_PRIMITIVES(GEN_ENTRY, gen) } }
+
+static const struct {
+    const char *name;
+    void (*iterations[ACCESS_COUNT])();
+} generators[] = {
+    GEN(lcg),
+    GEN(xorshift),
+    GEN(xoshiro),
+    GEN(pcg),
+    GEN(batch),
+    { NULL, { NULL } }
+};
+
+static void (*bench_iteration)();
+
 RUN_BENCH(run_bench, bench_iteration);
 
+static int generator = 0;
+
 static void
 init()
 {
     EXPECT_ERRNO(bench_pin_cpu() != -1);
 
-    data = mem_huge_alloc(bench_size);
+    data = mem_huge_alloc(bench_size + bench_access_slack());
     EXPECT_ERRNO(data != NULL);
-    for (int i = 0; i < bench_size; i++)
-	data[i] = i & 0xFF;
+    bench_set_data(data, bench_size + bench_access_slack());
+    mem_touch(data, bench_size + bench_access_slack(), 1);
+
+    lines =
+        (bench_size + bench_settings.line_size - 1) / bench_settings.line_size;
+    bench_set_work(lines, lines * bench_settings.line_size);
+
+    lcg_state = seed;
+    xorshift_state = seed ? seed : 1;
+    rnd_xoshiro256_seed(&xoshiro_state, seed);
+    pcg_state = seed;
+
+    bench_iteration =
+        generators[generator].iterations[access_index(
+                bench_settings.access_width, bench_settings.access_store)];
+
+    if (!strcmp(generators[generator].name, "batch")) {
+        rnd_batch_t b;
+
+        batch = malloc(lines * sizeof(*batch));
+        EXPECT_ERRNO(batch != NULL);
+        rnd_batch_seed(&b, seed);
+        rnd_batch_fill(&b, batch, lines, lines);
+        for (size_t i = 0; i < lines; i++)
+            batch[i] *= bench_settings.line_size;
+    }
 }
 
 static error_t
@@ -91,7 +186,15 @@ parse_opt (int key, char *arg, struct argp_state *state)
         break;
 
     case 'r':
-        lcg_state = argp_parse_uint64(state, "num", arg);
+        seed = argp_parse_uint64(state, "num", arg);
+        break;
+
+    case 'g':
+        for (generator = 0; generators[generator].name &&
+                 strcmp(arg, generators[generator].name); generator++)
+            ;
+        if (!generators[generator].name)
+            argp_error(state, "Invalid generator: %s\n", arg);
         break;
 
     case ARGP_KEY_ARG:
@@ -116,6 +219,9 @@ const char *argp_program_bug_address =
 static struct argp_option arg_options[] = {
     { "size", 's', "SIZE", 0, "Data set size", 0 },
     { "random-seed", 'r', "NUM", 0, "Random seed", 0 },
+    { "generator", 'g', "NAME", 0,
+      "Random number generator: lcg, xorshift, xoshiro, pcg or batch "
+      "(default: lcg)", 0 },
     { 0 }
 };
 
@@ -132,23 +238,28 @@ static struct argp argp = {
     "\v"
     "This microbenchmark accesses memory in a random fashion, reading one "
     "byte from a random cacheline in an array of a specific size. The number "
-    "of random accesses per iteration is the data_size / line_size.",
+    "of random accesses per iteration is the data_size / line_size. The "
+    "lcg generator reduces addresses using a modulo operation, which "
+    "is expensive for small data sets. The other generators use a "
+    "multiply-shift reduction, and the batch generator computes the "
+    "addresses before the benchmark starts.",
     .children = arg_children,
 };
 
 int
 main(int argc, char *argv[])
 {
+    bench_argp_run_bench = 1;
     argp_parse (&argp, argc, argv, 0, 0, NULL);
 
     init();
 
-    printf("Data size: %zu\n", bench_size);
-    printf("Seed: %" PRIu64 "\n", lcg_state);
+    bench_param("Data size", "%zu", bench_size);
+    bench_param("Seed", "%" PRIu64, seed);
+    bench_param("Generator", "%s", generators[generator].name);
     printf("Iterations: %u\n", bench_settings.iterations);
 
-    run_bench();
-    return 0;
+    return run_bench();
 }
 
 /*
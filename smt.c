@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "expect.h"
+#include "memory.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "access.h"
+#include "rnd_lcg.h"
+#include "timing.h"
+#include "topology.h"
+#include "bench_common.h"
+
+/* Number of operations between checks for the end of a run */
+#define CHUNK 4096
+
+typedef enum {
+    KERNEL_IDLE = 0,
+    KERNEL_RANDOM,
+    KERNEL_BLOCK,
+    KERNEL_ALU,
+} kernel_t;
+
+static const char *kernel_names[] = {
+    "idle", "random", "block", "alu", NULL
+};
+
+typedef struct {
+    int cpu;
+    pthread_t thread;
+
+    char *data;
+    size_t size;
+
+    /** Current position in the pointer chase */
+    void **chase;
+    /** Current offset of the block stream */
+    size_t pos;
+    /** State of the ALU kernel */
+    uint64_t alu;
+
+    uint64_t ops;
+} thread_t;
+
+static struct {
+    kernel_t kernel;
+    int quit;
+} point;
+
+static int fg_mask = -1;
+static int sibling_mask = -1;
+static int sibling_cpu = -1;
+static size_t bench_size = 0;
+static double duration = 1.0;
+
+static thread_t fg, sibling;
+static volatile int running;
+static pthread_barrier_t barrier_start, barrier_done;
+
+#define ACCESS access_rd8
+
+/**
+ * Link the lines of a thread's data set into a single random cycle
+ * (Sattolo's algorithm)
+ */
+static void
+init_chase(thread_t *t, uint64_t seed)
+{
+    const size_t line_size = bench_settings.line_size;
+    const size_t lines = t->size / line_size;
+    size_t *perm = malloc(lines * sizeof(*perm));
+    uint64_t lcg_state = seed;
+
+    EXPECT_ERRNO(perm != NULL);
+    for (size_t i = 0; i < lines; i++)
+        perm[i] = i;
+    for (size_t i = lines - 1; i > 0; i--) {
+        size_t j, tmp;
+
+        lcg_state = rnd_lcg64(lcg_state);
+        j = (lcg_state >> 16) % i;
+        tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+
+    for (size_t i = 0; i < lines; i++)
+        *(void **)(t->data + i * line_size) = t->data + perm[i] * line_size;
+
+    free(perm);
+    t->chase = (void **)t->data;
+}
+
+static inline void
+chunk_random(thread_t *t)
+{
+    void **p = t->chase;
+
+    for (int i = 0; i < CHUNK; i++)
+        p = (void **)*p;
+
+    t->chase = p;
+}
+
+static inline void
+chunk_block(thread_t *t)
+{
+    const size_t line_size = bench_settings.line_size;
+
+    for (int i = 0; i < CHUNK; i++) {
+        ACCESS(t->data + t->pos);
+        t->pos += line_size;
+        if (t->pos >= t->size)
+            t->pos = 0;
+    }
+}
+
+static inline void
+chunk_alu(thread_t *t)
+{
+    uint64_t x = t->alu;
+
+    for (int i = 0; i < CHUNK; i++)
+        x = rnd_lcg64(x) ^ (x >> 29);
+
+    t->alu = x;
+}
+
+static inline void
+run_chunk(thread_t *t, kernel_t kernel)
+{
+    switch (kernel) {
+    case KERNEL_RANDOM:
+        chunk_random(t);
+        break;
+    case KERNEL_BLOCK:
+        chunk_block(t);
+        break;
+    case KERNEL_ALU:
+        chunk_alu(t);
+        break;
+    case KERNEL_IDLE:
+        return;
+    }
+
+    t->ops += CHUNK;
+}
+
+static void
+init_thread(thread_t *t, uint64_t seed)
+{
+    t->size = bench_size;
+    t->data = mem_huge_alloc(t->size);
+    EXPECT_ERRNO(t->data != NULL);
+    mem_touch(t->data, t->size, 1);
+    init_chase(t, seed);
+    t->alu = seed;
+}
+
+static void *
+sibling_main(void *arg)
+{
+    thread_t *t = arg;
+
+    EXPECT_ERRNO(bench_pin_thread(t->cpu) != -1);
+
+    /* Allocate and touch the data set after pinning to get memory
+     * that is local to the CPU. */
+    init_thread(t, 4711ULL);
+
+    pthread_barrier_wait(&barrier_done);
+    while (1) {
+        pthread_barrier_wait(&barrier_start);
+        if (point.quit)
+            break;
+
+        t->ops = 0;
+        if (point.kernel != KERNEL_IDLE) {
+            while (running)
+                run_chunk(t, point.kernel);
+        }
+
+        pthread_barrier_wait(&barrier_done);
+    }
+
+    mem_huge_free(t->data, t->size);
+
+    return NULL;
+}
+
+/**
+ * Run the foreground kernel with a kernel on the sibling
+ *
+ * @return Foreground operations per second
+ */
+static double
+measure(kernel_t kernel, kernel_t sibling_kernel, double *sibling_rate)
+{
+    timing_t t;
+
+    point.kernel = sibling_kernel;
+    running = 1;
+    pthread_barrier_wait(&barrier_start);
+
+    fg.ops = 0;
+    timing_init(&t);
+    timing_start(&t);
+    do {
+        run_chunk(&fg, kernel);
+        timing_stop(&t);
+        timing_start(&t);
+    } while (t.acc < duration);
+    timing_stop(&t);
+
+    running = 0;
+    pthread_barrier_wait(&barrier_done);
+
+    *sibling_rate = sibling.ops / t.acc;
+    return fg.ops / t.acc;
+}
+
+static void
+run()
+{
+    printf("%-10s %-10s %14s %10s %14s\n",
+           "Foreground", "Sibling", "Fg ops/s", "Slowdown", "Sibling ops/s");
+
+    for (kernel_t k = KERNEL_RANDOM; kernel_names[k]; k++) {
+        double idle_rate, sibling_rate;
+
+        if (!(fg_mask & (1 << k)))
+            continue;
+
+        idle_rate = measure(k, KERNEL_IDLE, &sibling_rate);
+        printf("%-10s %-10s %14.0f %10.3f %14s\n",
+               kernel_names[k], kernel_names[KERNEL_IDLE],
+               idle_rate, 1.0, "-");
+
+        for (kernel_t s = KERNEL_RANDOM; kernel_names[s]; s++) {
+            double rate;
+
+            if (!(sibling_mask & (1 << s)))
+                continue;
+
+            rate = measure(k, s, &sibling_rate);
+            printf("%-10s %-10s %14.0f %10.3f %14.0f\n",
+                   kernel_names[k], kernel_names[s],
+                   rate, idle_rate / rate, sibling_rate);
+        }
+    }
+
+    point.quit = 1;
+    pthread_barrier_wait(&barrier_start);
+    EXPECT(pthread_join(sibling.thread, NULL) == 0);
+}
+
+static void
+init()
+{
+    fg.cpu = bench_settings.cpu != -1 ? bench_settings.cpu :
+        bench_settings.cpus[0];
+
+    if (sibling_cpu == -1) {
+        int *siblings;
+        int count = topology_siblings(fg.cpu, &siblings);
+
+        EXPECT_ERRNO(count != -1);
+        for (int i = 0; i < count; i++) {
+            if (siblings[i] != fg.cpu) {
+                sibling_cpu = siblings[i];
+                break;
+            }
+        }
+        free(siblings);
+
+        if (sibling_cpu == -1) {
+            fprintf(stderr, "CPU %i has no SMT siblings, use --sibling "
+                    "to select a CPU.\n", fg.cpu);
+            exit(EXIT_FAILURE);
+        }
+    }
+    sibling.cpu = sibling_cpu;
+
+    if (!bench_size)
+        bench_size = 2 * bench_settings.cache_shared;
+    bench_size -= bench_size % bench_settings.line_size;
+    if (bench_size < bench_settings.line_size)
+        bench_size = bench_settings.line_size;
+
+    EXPECT_ERRNO(bench_pin_thread(fg.cpu) != -1);
+    init_thread(&fg, 42ULL);
+
+    EXPECT(pthread_barrier_init(&barrier_start, NULL, 2) == 0);
+    EXPECT(pthread_barrier_init(&barrier_done, NULL, 2) == 0);
+    EXPECT(pthread_create(&sibling.thread, NULL, sibling_main,
+                          &sibling) == 0);
+    pthread_barrier_wait(&barrier_done);
+}
+
+static int
+parse_kernel(struct argp_state *state, const char *name, const char *arg)
+{
+    if (!strcmp(arg, "all"))
+        return -1;
+
+    for (int i = KERNEL_RANDOM; kernel_names[i]; i++) {
+        if (!strcmp(arg, kernel_names[i]))
+            return 1 << i;
+    }
+
+    argp_error(state, "Invalid %s: %s\n", name, arg);
+    return 0;
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'f':
+        fg_mask = parse_kernel(state, "foreground kernel", arg);
+        break;
+
+    case 'k':
+        sibling_mask = parse_kernel(state, "sibling kernel", arg);
+        break;
+
+    case 'S':
+        sibling_cpu = argp_parse_int(state, "sibling", arg);
+        break;
+
+    case 's':
+        bench_size = argp_parse_size(state, "size", arg);
+        break;
+
+    case 't':
+        duration = argp_parse_double(state, "duration", arg);
+        if (duration <= 0.0)
+            argp_error(state, "Invalid duration: Must be positive.\n");
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "smt";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "foreground", 'f', "KERNEL", 0,
+      "Foreground kernel: random, block, alu or all (default: all)", 0 },
+    { "kernel", 'k', "KERNEL", 0,
+      "Sibling kernel: random, block, alu or all (default: all)", 0 },
+    { "sibling", 'S', "CPU", 0,
+      "Run the sibling kernel on CPU instead of an SMT sibling", 0 },
+    { "size", 's', "SIZE", 0,
+      "Data set size per thread (default: 2 * shared cache size)", 0 },
+    { "time", 't', "SECONDS", 0,
+      "Duration of each measurement (default: 1)", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "SMT sibling interference"
+    "\v"
+    "This microbenchmark runs a foreground kernel on one hardware thread "
+    "while another kernel runs on an SMT sibling of the same core. The "
+    "sibling is discovered from sysfs "
+    "(topology/thread_siblings_list), the foreground runs on the CPU "
+    "selected by --cpu or the first CPU in --cpus. The kernels are a "
+    "dependent random pointer chase (random), a sequential stream "
+    "(block) and a dependent chain of integer operations (alu). The "
+    "foreground throughput is reported together with the slowdown "
+    "compared to an idle sibling.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    printf("Foreground CPU: %i\n", fg.cpu);
+    printf("Sibling CPU: %i\n", sibling.cpu);
+    bench_param("Data size", "%zu", bench_size);
+    bench_param("Duration", "%g", duration);
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "expect.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "rnd_lcg.h"
+#include "stats.h"
+#include "timing.h"
+#include "bench_common.h"
+
+#define ALIGNMENT 4096
+#define MAX_DEPTH 4096
+
+/* A queue depth is considered saturating when it reaches this
+ * fraction of the best IOPS in a sweep. */
+#define SATURATION 0.95
+
+typedef enum {
+    METHOD_PREAD = 0,
+    METHOD_THREADS,
+    METHOD_URING,
+    METHOD_COUNT
+} method_t;
+
+static const char *method_names[] = { "pread", "threads", "io_uring", NULL };
+
+static const char *pattern_names[] = { "seq", "random", NULL };
+
+static const char *mode_names[] = { "buffered", "direct", NULL };
+
+static size_t bench_size = 256 * 1024 * 1024;
+static size_t min_block = 4096;
+static size_t max_block = 128 * 1024;
+static unsigned max_depth = 64;
+static uint64_t nops = 10000;
+static uint64_t seed = 42ULL;
+static const char *file_name = NULL;
+static int method_mask = (1 << METHOD_COUNT) - 1;
+static int pattern_mask = 3;
+static int mode_mask = 3;
+
+static char temp_name[] = "storage.XXXXXX";
+static int temp_created = 0;
+
+static off_t *offsets;
+static uint64_t *latencies;
+
+static const double percentiles[] = { 50, 90, 99, 99.9 };
+#define NPERCENTILES (sizeof(percentiles) / sizeof(*percentiles))
+
+typedef struct {
+    int fd;
+    size_t block;
+    unsigned depth;
+} point_t;
+
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *
+alloc_buffer(size_t size)
+{
+    void *buf;
+
+    EXPECT(posix_memalign(&buf, ALIGNMENT, size) == 0);
+    return buf;
+}
+
+static void
+gen_offsets(int random, size_t block)
+{
+    const size_t blocks = bench_size / block;
+    uint64_t lcg_state = seed;
+
+    for (uint64_t i = 0; i < nops; i++) {
+        if (random) {
+            lcg_state = rnd_lcg64(lcg_state);
+            offsets[i] = (off_t)(lcg_state % blocks) * block;
+        } else
+            offsets[i] = (off_t)(i % blocks) * block;
+    }
+}
+
+/**
+ * Blocking pread from a single thread
+ *
+ * @return 0 on success, -1 on error
+ */
+static int
+run_pread(const point_t *p)
+{
+    char *buf = alloc_buffer(p->block);
+
+    for (uint64_t i = 0; i < nops; i++) {
+        const uint64_t start = now_ns();
+        if (pread(p->fd, buf, p->block, offsets[i]) != p->block) {
+            free(buf);
+            return -1;
+        }
+        latencies[i] = now_ns() - start;
+    }
+
+    free(buf);
+    return 0;
+}
+
+static pthread_barrier_t barrier_start;
+static uint64_t next_op;
+static int pool_error;
+
+static void *
+pool_thread(void *arg)
+{
+    const point_t *p = (const point_t *)arg;
+    char *buf = alloc_buffer(p->block);
+    uint64_t i;
+
+    pthread_barrier_wait(&barrier_start);
+
+    while ((i = __atomic_fetch_add(&next_op, 1, __ATOMIC_RELAXED)) < nops) {
+        const uint64_t start = now_ns();
+        if (pread(p->fd, buf, p->block, offsets[i]) != p->block) {
+            __atomic_store_n(&pool_error, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        latencies[i] = now_ns() - start;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/**
+ * Blocking pread from a pool of one thread per outstanding request
+ *
+ * The pool is created outside of the timed region, the caller starts
+ * timing when this function returns from the start barrier.
+ */
+static int
+run_threads(const point_t *p, timing_t *t)
+{
+    pthread_t threads[p->depth];
+
+    next_op = 0;
+    pool_error = 0;
+    EXPECT(pthread_barrier_init(&barrier_start, NULL, p->depth + 1) == 0);
+    for (unsigned i = 0; i < p->depth; i++)
+        EXPECT(pthread_create(&threads[i], NULL, pool_thread,
+                              (void *)p) == 0);
+
+    pthread_barrier_wait(&barrier_start);
+    timing_start(t);
+    for (unsigned i = 0; i < p->depth; i++)
+        EXPECT(pthread_join(threads[i], NULL) == 0);
+    timing_stop(t);
+
+    EXPECT(pthread_barrier_destroy(&barrier_start) == 0);
+
+    return pool_error ? -1 : 0;
+}
+
+typedef struct {
+    int fd;
+    unsigned entries;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+} uring_t;
+
+static int
+uring_setup(uring_t *r, unsigned entries)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    r->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (r->fd < 0)
+        return -1;
+
+    r->entries = params.sq_entries;
+    r->sq_ring_size = params.sq_off.array +
+        params.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size)
+            r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    EXPECT_ERRNO(r->sq_ring != MAP_FAILED);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd,
+                          IORING_OFF_CQ_RING);
+        EXPECT_ERRNO(r->cq_ring != MAP_FAILED);
+    }
+
+    r->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    EXPECT_ERRNO(r->sqes != MAP_FAILED);
+
+    r->sq_head = (unsigned *)((char *)r->sq_ring + params.sq_off.head);
+    r->sq_tail = (unsigned *)((char *)r->sq_ring + params.sq_off.tail);
+    r->sq_mask = (unsigned *)((char *)r->sq_ring + params.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_ring + params.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_ring + params.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_ring + params.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_ring + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ring +
+                                      params.cq_off.cqes);
+
+    return 0;
+}
+
+static void
+uring_teardown(uring_t *r)
+{
+    EXPECT_ERRNO(munmap(r->sqes,
+                        r->entries * sizeof(struct io_uring_sqe)) == 0);
+    if (r->cq_ring != r->sq_ring)
+        EXPECT_ERRNO(munmap(r->cq_ring, r->cq_ring_size) == 0);
+    EXPECT_ERRNO(munmap(r->sq_ring, r->sq_ring_size) == 0);
+    EXPECT_ERRNO(close(r->fd) == 0);
+}
+
+/**
+ * io_uring with one registered buffer per outstanding request and the
+ * file registered as fixed file 0
+ */
+static int
+run_uring(const point_t *p, timing_t *t)
+{
+    const unsigned depth = p->depth;
+    struct iovec iov[depth];
+    unsigned free_slots[depth];
+    uint64_t submit_time[depth];
+    unsigned nfree = depth;
+    uint64_t submitted = 0, completed = 0;
+    int ret = 0, err;
+    uring_t r;
+
+    if (uring_setup(&r, depth) == -1)
+        return -1;
+
+    for (unsigned i = 0; i < depth; i++) {
+        iov[i].iov_base = alloc_buffer(p->block);
+        iov[i].iov_len = p->block;
+        free_slots[i] = i;
+    }
+
+    if (syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS,
+                iov, depth) < 0 ||
+        syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_FILES,
+                &p->fd, 1) < 0) {
+        ret = -1;
+        goto out;
+    }
+
+    timing_start(t);
+    while (completed < nops) {
+        unsigned tail = *r.sq_tail;
+        unsigned to_submit = 0;
+        unsigned head;
+
+        while (nfree && submitted < nops) {
+            const unsigned slot = free_slots[--nfree];
+            const unsigned idx = tail & *r.sq_mask;
+            struct io_uring_sqe *sqe = &r.sqes[idx];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->fd = 0;
+            sqe->addr = (uint64_t)(uintptr_t)iov[slot].iov_base;
+            sqe->len = p->block;
+            sqe->off = offsets[submitted];
+            sqe->buf_index = slot;
+            sqe->user_data = ((uint64_t)submitted << 32) | slot;
+            r.sq_array[idx] = idx;
+
+            submit_time[slot] = now_ns();
+            tail++;
+            to_submit++;
+            submitted++;
+        }
+        __atomic_store_n(r.sq_tail, tail, __ATOMIC_RELEASE);
+
+        if (syscall(__NR_io_uring_enter, r.fd, to_submit, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            ret = -1;
+            break;
+        }
+
+        head = *r.cq_head;
+        while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+            const struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+            const unsigned slot = cqe->user_data & 0xFFFFFFFF;
+            const uint64_t op = cqe->user_data >> 32;
+
+            if (cqe->res != p->block && ret != -1) {
+                errno = cqe->res < 0 ? -cqe->res : EIO;
+                ret = -1;
+            }
+            latencies[op] = now_ns() - submit_time[slot];
+            free_slots[nfree++] = slot;
+            completed++;
+            head++;
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+
+        if (ret == -1)
+            break;
+    }
+    timing_stop(t);
+
+out:
+    /* Report the error that stopped the run, not one from cleaning up */
+    err = errno;
+    uring_teardown(&r);
+    for (unsigned i = 0; i < depth; i++)
+        free(iov[i].iov_base);
+    errno = err;
+
+    return ret;
+}
+
+/**
+ * Measure one configuration
+ *
+ * @return IOPS or 0 if the configuration is unavailable
+ */
+static double
+measure(method_t method, int pattern, int mode, size_t block,
+        unsigned depth)
+{
+    point_t p = {
+        .block = block,
+        .depth = depth,
+    };
+    timing_t t;
+    int ret;
+
+    printf("%-9s %-7s %-9s %8zu %5u ",
+           method_names[method], pattern_names[pattern], mode_names[mode],
+           block, depth);
+
+    p.fd = open(file_name, O_RDONLY | (mode ? O_DIRECT : 0));
+    if (p.fd == -1) {
+        printf("unavailable (%s)\n", strerror(errno));
+        return 0;
+    }
+    EXPECT(posix_fadvise(p.fd, 0, 0, POSIX_FADV_DONTNEED) == 0);
+
+    timing_init(&t);
+    switch (method) {
+    case METHOD_PREAD:
+        timing_start(&t);
+        ret = run_pread(&p);
+        timing_stop(&t);
+        break;
+
+    case METHOD_THREADS:
+        ret = run_threads(&p, &t);
+        break;
+
+    case METHOD_URING:
+        ret = run_uring(&p, &t);
+        break;
+
+    default:
+        abort();
+    }
+    EXPECT_ERRNO(close(p.fd) == 0);
+
+    if (ret == -1) {
+        printf("unavailable (%s)\n", strerror(errno));
+        return 0;
+    }
+
+    stats_sort_u64(latencies, nops);
+    printf("%10.0f %9.1f",
+           nops / t.acc, nops * block / t.acc / (1024 * 1024));
+    for (int i = 0; i < NPERCENTILES; i++)
+        printf(" %9.1f",
+               stats_percentile_u64(latencies, nops, percentiles[i]) * 1E-3);
+    printf("\n");
+
+    return nops / t.acc;
+}
+
+static void
+run()
+{
+    char label[32];
+
+    printf("%-9s %-7s %-9s %8s %5s %10s %9s",
+           "Method", "Pattern", "Mode", "Block", "QD", "IOPS", "MiB/s");
+    for (int i = 0; i < NPERCENTILES; i++) {
+        snprintf(label, sizeof(label), "p%g [us]", percentiles[i]);
+        printf(" %9s", label);
+    }
+    printf("\n");
+
+    for (int pattern = 0; pattern_names[pattern]; pattern++) {
+        if (!(pattern_mask & (1 << pattern)))
+            continue;
+        for (size_t block = min_block; block <= max_block; block *= 2) {
+            gen_offsets(pattern, block);
+            for (int mode = 0; mode_names[mode]; mode++) {
+                if (!(mode_mask & (1 << mode)))
+                    continue;
+                for (method_t m = 0; m < METHOD_COUNT; m++) {
+                    const unsigned depth_limit =
+                        m == METHOD_PREAD ? 1 : max_depth;
+                    double iops[32], best = 0;
+                    unsigned n = 0;
+
+                    if (!(method_mask & (1 << m)))
+                        continue;
+
+                    for (unsigned d = 1; d <= depth_limit; d *= 2, n++) {
+                        iops[n] = measure(m, pattern, mode, block, d);
+                        if (iops[n] > best)
+                            best = iops[n];
+                    }
+
+                    if (n > 1 && best > 0) {
+                        for (unsigned i = 0; i < n; i++) {
+                            if (iops[i] >= SATURATION * best) {
+                                printf("Saturation: %s %s %s %zu at QD %u\n",
+                                       method_names[m],
+                                       pattern_names[pattern],
+                                       mode_names[mode], block, 1U << i);
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void
+cleanup()
+{
+    if (temp_created)
+        unlink(temp_name);
+}
+
+static void
+init()
+{
+    const size_t chunk = max_block;
+    char *buf;
+    int fd;
+
+    bench_size -= bench_size % max_block;
+    if (!bench_size)
+        bench_size = max_block;
+
+    offsets = malloc(nops * sizeof(*offsets));
+    EXPECT_ERRNO(offsets != NULL);
+    latencies = malloc(nops * sizeof(*latencies));
+    EXPECT_ERRNO(latencies != NULL);
+
+    if (file_name) {
+        fd = open(file_name, O_RDWR | O_CREAT, 0600);
+    } else {
+        fd = mkstemp(temp_name);
+        temp_created = fd != -1;
+        atexit(cleanup);
+        file_name = temp_name;
+    }
+    EXPECT_ERRNO(fd != -1);
+
+    buf = alloc_buffer(chunk);
+    for (size_t i = 0; i < chunk; i++)
+        buf[i] = i & 0xFF;
+    for (off_t off = 0; off < bench_size; off += chunk)
+        EXPECT_ERRNO(pwrite(fd, buf, chunk, off) == chunk);
+    EXPECT_ERRNO(fsync(fd) == 0);
+    EXPECT_ERRNO(close(fd) == 0);
+    free(buf);
+}
+
+static int
+parse_mask(struct argp_state *state, const char *name, const char *arg,
+           const char **names)
+{
+    if (!strcmp(arg, "all"))
+        return -1;
+
+    for (int i = 0; names[i]; i++) {
+        if (!strcmp(arg, names[i]))
+            return 1 << i;
+    }
+
+    argp_error(state, "Invalid %s: %s\n", name, arg);
+    return 0;
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 's':
+        bench_size = argp_parse_size(state, "size", arg);
+        break;
+
+    case 'b':
+        min_block = argp_parse_size(state, "minimum block size", arg);
+        break;
+
+    case 'B':
+        max_block = argp_parse_size(state, "maximum block size", arg);
+        break;
+
+    case 'q':
+        max_depth = argp_parse_uint(state, "queue depth", arg);
+        if (!max_depth || max_depth > MAX_DEPTH)
+            argp_error(state, "Invalid queue depth: Must be between 1 "
+                       "and %i.\n", MAX_DEPTH);
+        break;
+
+    case 'n':
+        nops = argp_parse_uint64(state, "number of operations", arg);
+        if (!nops)
+            argp_error(state, "Invalid number of operations.\n");
+        break;
+
+    case 'm':
+        method_mask = parse_mask(state, "method", arg, method_names);
+        break;
+
+    case 'p':
+        pattern_mask = parse_mask(state, "pattern", arg, pattern_names);
+        break;
+
+    case 'd':
+        mode_mask = parse_mask(state, "mode", arg, mode_names);
+        break;
+
+    case 'f':
+        file_name = arg;
+        break;
+
+    case 'r':
+        seed = argp_parse_uint64(state, "random seed", arg);
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        if (!min_block || min_block % ALIGNMENT || max_block < min_block)
+            argp_error(state, "Invalid block sizes: Must be non-zero "
+                       "multiples of %i and min <= max.\n", ALIGNMENT);
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "storage";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "size", 's', "SIZE", 0, "File size (default: 256 MiB)", 0 },
+    { "min-block", 'b', "SIZE", 0, "Minimum block size (default: 4 KiB)", 0 },
+    { "max-block", 'B', "SIZE", 0,
+      "Maximum block size (default: 128 KiB)", 0 },
+    { "queue-depth", 'q', "NUM", 0, "Maximum queue depth (default: 64)", 0 },
+    { "ops", 'n', "NUM", 0,
+      "Number of reads per configuration (default: 10000)", 0 },
+    { "method", 'm', "METHOD", 0,
+      "Method: pread, threads, io_uring or all (default: all)", 0 },
+    { "pattern", 'p', "PATTERN", 0,
+      "Access pattern: seq, random or all (default: all)", 0 },
+    { "mode", 'd', "MODE", 0,
+      "File mode: buffered, direct or all (default: all)", 0 },
+    { "file", 'f', "FILE", 0,
+      "Use FILE instead of a temporary file in the current directory, "
+      "the file is overwritten", 0 },
+    { "random-seed", 'r', "NUM", 0, "Random seed", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Storage read throughput and latency"
+    "\v"
+    "This microbenchmark issues sequential or random block reads "
+    "against a file using blocking pread from a single thread, pread "
+    "from a pool with one thread per outstanding request, and io_uring "
+    "with registered buffers and a fixed file. The queue depth is swept "
+    "in powers of two up to the maximum, and the block size from the "
+    "minimum to the maximum block size. Each configuration is run with "
+    "buffered I/O and O_DIRECT, the page cache is dropped before every "
+    "run. For every sweep, the smallest queue depth that reaches 95% of "
+    "the best IOPS is reported as the saturation point.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    init();
+
+    printf("File: %s\n", file_name);
+    bench_param("Data size", "%zu", bench_size);
+    bench_param("Operations", "%" PRIu64, nops);
+    bench_param("Seed", "%" PRIu64, seed);
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */
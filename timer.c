@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2011, Andreas Sandberg
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <argp.h>
+#include <errno.h>
+
+#include "expect.h"
+#include "stats.h"
+#include "bench_argp.h"
+#include "argp_utils.h"
+#include "bench_common.h"
+
+/* Number of calls used to measure the cost of a time source */
+#define COST_CALLS 100000
+
+typedef struct {
+    const char *name;
+    /** Unit of the deltas */
+    const char *unit;
+    /** Store n back-to-back deltas in d */
+    void (*deltas)(uint64_t *d, size_t n);
+    /** Read the source n times, return something to keep the reads */
+    uint64_t (*calls)(size_t n);
+} source_t;
+
+#define COUNTER_SOURCE(name, expr)                      \
+    static void                                         \
+    name ## _deltas(uint64_t *d, size_t n)              \
+    {                                                   \
+        for (size_t i = 0; i < n; i++) {                \
+            const uint64_t a = expr;                    \
+            const uint64_t b = expr;                    \
+            d[i] = b - a;                               \
+        }                                               \
+    }                                                   \
+                                                        \
+    static uint64_t                                     \
+    name ## _calls(size_t n)                            \
+    {                                                   \
+        uint64_t acc = 0;                               \
+        for (size_t i = 0; i < n; i++)                  \
+            acc += expr;                                \
+        return acc;                                     \
+    }
+
+COUNTER_SOURCE(cycles, cycles_get())
+COUNTER_SOURCE(cycles_mfenced, cycles_get_mfenced())
+#if defined(__i386__) || defined(__x86_64__)
+COUNTER_SOURCE(rdtscp, x86_tscp_read(NULL))
+COUNTER_SOURCE(lfence_rdtsc, x86_tsc_read_lfenced())
+#endif
+
+static void
+timing_deltas(uint64_t *d, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        timing_t t;
+
+        timing_init(&t);
+        timing_start(&t);
+        timing_stop(&t);
+        d[i] = t.acc * 1E9 + 0.5;
+    }
+}
+
+static uint64_t
+timing_calls(size_t n)
+{
+    timing_t t;
+
+    timing_init(&t);
+    for (size_t i = 0; i < n; i++) {
+        timing_start(&t);
+        timing_stop(&t);
+    }
+    return t.acc;
+}
+
+static const source_t sources[] = {
+    { "cycles_get", "ticks", cycles_deltas, cycles_calls },
+    { "cycles_get_mfenced", "ticks",
+      cycles_mfenced_deltas, cycles_mfenced_calls },
+#if defined(__i386__) || defined(__x86_64__)
+    { "rdtscp", "ticks", rdtscp_deltas, rdtscp_calls },
+    { "lfence+rdtsc", "ticks", lfence_rdtsc_deltas, lfence_rdtsc_calls },
+#endif
+    { "timing_start/stop", "ns", timing_deltas, timing_calls },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const double percentiles[] = { 1, 10, 50, 90, 99, 99.9 };
+#define NPERCENTILES (sizeof(percentiles) / sizeof(*percentiles))
+
+static size_t samples = 100000;
+static uint64_t *deltas;
+
+/**
+ * Measure a time source
+ *
+ * @return Smallest non-zero delta
+ */
+static uint64_t
+measure(const source_t *src)
+{
+    uint64_t start, cycles;
+    uint64_t granularity = 0;
+    size_t zeros = 0;
+    volatile uint64_t sink;
+
+    start = cycles_get();
+    sink = src->calls(COST_CALLS);
+    cycles = cycles_get() - start;
+    (void)sink;
+
+    src->deltas(deltas, samples);
+    stats_sort_u64(deltas, samples);
+    while (zeros < samples && !deltas[zeros])
+        zeros++;
+    if (zeros < samples)
+        granularity = deltas[zeros];
+
+    printf("%-20s %-6s %8.1f %7.2f%% %8" PRIu64,
+           src->name, src->unit, (double)cycles / COST_CALLS,
+           100.0 * zeros / samples, deltas[0]);
+    for (int i = 0; i < NPERCENTILES; i++)
+        printf(" %8" PRIu64,
+               stats_percentile_u64(deltas, samples, percentiles[i]));
+    printf(" %8" PRIu64 "\n", deltas[samples - 1]);
+
+    return granularity;
+}
+
+static void
+run()
+{
+    uint64_t timing_granularity = 0;
+
+    printf("%-20s %-6s %8s %8s %8s", "Source", "Unit", "Cost", "Zero",
+           "Min");
+    for (int i = 0; i < NPERCENTILES; i++) {
+        char label[16];
+
+        snprintf(label, sizeof(label), "p%g", percentiles[i]);
+        printf(" %8s", label);
+    }
+    printf(" %8s\n", "Max");
+
+    for (int i = 0; sources[i].name; i++) {
+        const uint64_t g = measure(&sources[i]);
+
+        if (sources[i].deltas == timing_deltas)
+            timing_granularity = g;
+    }
+
+    printf("timing_precision(): %.0f ns\n", timing_precision() * 1E9);
+    printf("Observed timing granularity: %" PRIu64 " ns\n",
+           timing_granularity);
+    printf("Per-iteration correction: %" PRIu64 " ticks\n",
+           bench_timer_overhead());
+}
+
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+    switch (key)
+    {
+    case 'n':
+        samples = argp_parse_size(state, "samples", arg);
+        if (!samples)
+            argp_error(state, "Invalid samples: Must be at least 1.\n");
+        break;
+
+    case ARGP_KEY_ARG:
+	argp_usage(state);
+        break;
+
+    case ARGP_KEY_END:
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+const char *argp_program_version =
+    "timer";
+
+const char *argp_program_bug_address =
+    "andreas.sandberg@it.uu.se";
+
+static struct argp_option arg_options[] = {
+    { "samples", 'n', "NUM", 0,
+      "Back-to-back deltas per source (default: 100000)", 0 },
+    { 0 }
+};
+
+static struct argp_child arg_children[] = {
+    { &bench_argp, 0, "Common options:", 0 },
+    { 0 }
+};
+
+static struct argp argp = {
+    .options = arg_options,
+    .parser = parse_opt,
+    .args_doc = "",
+    .doc = "Measure the cost and resolution of the time sources"
+    "\v"
+    "This microbenchmark reads every time source used by the suite twice in "
+    "a row and reports the distribution of the differences in the source's "
+    "own unit, the fraction of zero differences and the cost of one read "
+    "in cycle counter ticks. The clock_gettime based timing functions are "
+    "measured as a timing_start/timing_stop pair. The observed granularity "
+    "of the clock is compared with timing_precision(), and the overhead "
+    "that RUN_BENCH subtracts from per-iteration samples is printed.",
+    .children = arg_children,
+};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse (&argp, argc, argv, 0, 0, NULL);
+
+    EXPECT_ERRNO(bench_pin_cpu() != -1);
+
+    deltas = malloc(samples * sizeof(*deltas));
+    EXPECT_ERRNO(deltas != NULL);
+
+    printf("Cycle counter: %s\n", cycles_backend_name());
+    printf("Samples: %zu\n", samples);
+
+    run();
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * c-file-style: "k&r"
+ * End:
+ */